@@ -2,9 +2,18 @@
 #define _BYFXXM_CODE_HPP_
 
 #include "md_array.hpp"
+#include "recycler.hpp"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <variant>
 
 namespace byfxxm {
 using AxesArray = MdArray<double, 1>;
+inline constexpr size_t axes_count = 6;
+using Axes = std::array<double, axes_count>;
 
 enum class codetag {
   NA,
@@ -13,7 +22,10 @@ enum class codetag {
   ARC,
 };
 
-struct Code {
+// 由Recycler分配，经std::unique_ptr<Code>释放时按实际类型析构和回收
+struct Code : Recyclable {
+  Code(codetag tag_ = codetag::NA) : tag(tag_) {}
+  virtual ~Code() = default;
   codetag tag{codetag::NA};
 };
 
@@ -35,6 +47,100 @@ struct Arc : Code {
   AxesArray center;
   bool ccw{false};
 };
+
+// 值类型的码，坐标内联存放
+namespace record {
+struct Move {
+  Axes end;
+};
+
+struct Line {
+  Axes end;
+};
+
+struct Arc {
+  Axes end;
+  Axes center;
+  bool ccw{false};
+};
+} // namespace record
+
+// 可平凡复制，Fifo中按值存放，传递时只复制槽位，不访问堆
+// 默认构造的记录为空，作为结束标记，与空的std::unique_ptr<Code>相当
+class CodeRecord {
+public:
+  using Variant =
+      std::variant<std::monostate, record::Move, record::Line, record::Arc>;
+
+  CodeRecord() = default;
+  CodeRecord(const record::Move &move) : _value(move) {}
+  CodeRecord(const record::Line &line) : _value(line) {}
+  CodeRecord(const record::Arc &arc) : _value(arc) {}
+
+  explicit operator bool() const { return _value.index() != 0; }
+
+  // 备选类型的顺序与codetag一致
+  codetag Tag() const { return static_cast<codetag>(_value.index()); }
+
+  template <class T> const T *Get() const { return std::get_if<T>(&_value); }
+
+  template <class T> T *Get() { return std::get_if<T>(&_value); }
+
+  template <class F> decltype(auto) Visit(F &&f) const {
+    return std::visit(std::forward<F>(f), _value);
+  }
+
+private:
+  Variant _value;
+};
+
+static_assert(std::is_trivially_copyable_v<CodeRecord>);
+static_assert(sizeof(CodeRecord) <= 128); // 不超过两个缓存行
+
+inline AxesArray ToAxesArray(const Axes &axes) {
+  AxesArray ret(size_t{axes_count});
+  std::ranges::copy(axes, ret.begin());
+  return ret;
+}
+
+inline Axes ToAxes(const AxesArray &axes) {
+  Axes ret;
+  ret.fill(std::numeric_limits<double>::quiet_NaN());
+  std::copy_n(axes.begin(), std::min(axes.Shape<0>(), axes_count), ret.begin());
+  return ret;
+}
+
+// 记录与多态码之间的转换，空记录对应空指针
+inline std::unique_ptr<Code> ToCode(const CodeRecord &rec) {
+  switch (rec.Tag()) {
+  case codetag::MOVE:
+    return std::make_unique<Move>(ToAxesArray(rec.Get<record::Move>()->end));
+  case codetag::LINE:
+    return std::make_unique<Line>(ToAxesArray(rec.Get<record::Line>()->end));
+  case codetag::ARC: {
+    auto arc = rec.Get<record::Arc>();
+    return std::make_unique<Arc>(ToAxesArray(arc->end),
+                                 ToAxesArray(arc->center), arc->ccw);
+  }
+  default:
+    return nullptr;
+  }
+}
+
+inline CodeRecord ToRecord(const Code *code) {
+  switch (code ? code->tag : codetag::NA) {
+  case codetag::MOVE:
+    return record::Move{ToAxes(static_cast<const Move *>(code)->end)};
+  case codetag::LINE:
+    return record::Line{ToAxes(static_cast<const Line *>(code)->end)};
+  case codetag::ARC: {
+    auto arc = static_cast<const Arc *>(code);
+    return record::Arc{ToAxes(arc->end), ToAxes(arc->center), arc->ccw};
+  }
+  default:
+    return {};
+  }
+}
 } // namespace byfxxm
 
 #endif
@@ -1,7 +1,8 @@
 ﻿#ifndef _BYFXXM_CORO_HPP_
 #define _BYFXXM_CORO_HPP_
 
-#include <Windows.h>
+#include "coro_context.hpp"
+#include <functional>
 #include <future>
 #include <memory>
 #include <tuple>
@@ -13,7 +14,7 @@ class CoSubHelper;
 using _CoMainFunc = std::function<void(CoMainHelper *, void *)>;
 using _CoSubFunc = std::function<void(CoSubHelper *, void *)>;
 using _CoUserPtr = void *;
-using _CoPtr = std::unique_ptr<void, std::function<void(void *)>>;
+using _CoPtr = std::unique_ptr<CoContext>;
 using _CoMain = std::tuple<_CoMainFunc, _CoUserPtr, _CoPtr>;
 using _CoSub = std::tuple<_CoSubFunc, _CoUserPtr, _CoPtr>;
 
@@ -22,7 +23,7 @@ public:
   CoMainHelper(const std::vector<_CoSub> &co_list) : _co_subs(co_list) {}
 
   void SwitchToSub(size_t n) {
-    SwitchToFiber(std::get<_CoPtr>(_co_subs[n]).get());
+    std::get<_CoPtr>(_co_subs[n])->Resume();
   }
 
 private:
@@ -31,12 +32,17 @@ private:
 
 class CoSubHelper {
 public:
-  CoSubHelper(const _CoMain &co) : _co_main(co) {}
+  CoSubHelper(const _CoMain &co, const std::vector<_CoSub> &co_list)
+      : _co_main(co), _co_subs(co_list) {}
 
-  void SwitchToMain() { SwitchToFiber(std::get<_CoPtr>(_co_main).get()); }
+  void SwitchToMain() { std::get<_CoPtr>(_co_main)->Resume(); }
+
+  // 子协程之间直接切换，不经过主协程
+  void SwitchToSub(size_t n) { std::get<_CoPtr>(_co_subs[n])->Resume(); }
 
 private:
   const _CoMain &_co_main;
+  const std::vector<_CoSub> &_co_subs;
 };
 
 class Coro {
@@ -57,6 +63,9 @@ public:
     _co_subs.emplace_back(func, user, nullptr);
   }
 
+  // 每个子协程的栈大小，在Run之前设置
+  void SetStackSize(size_t stack_size) { _stack_size = stack_size; }
+
   void AsyncRun() {
     if (_runtime.valid())
       return;
@@ -79,34 +88,48 @@ public:
 
 private:
   void _DoRun() {
-    CoSubHelper sub_helper(_co_main);
-    std::vector<std::unique_ptr<std::packaged_task<void()>>> co_binds(
-        _co_subs.size());
+    // 主协程的上下文先于子协程创建、后于子协程销毁
+    std::get<_CoPtr>(_co_main) = std::make_unique<CoContext>();
+    CoSubHelper sub_helper(_co_main, _co_subs);
+    std::vector<std::unique_ptr<_SubEntry>> co_binds(_co_subs.size());
     for (size_t i = 0; i < _co_subs.size(); ++i) {
       auto &co = _co_subs[i];
       auto &co_bind = co_binds[i];
-      co_bind = std::make_unique<std::packaged_task<void()>>(std::bind(
-          std::get<_CoSubFunc>(co), &sub_helper, std::get<_CoUserPtr>(co)));
-
-      auto fiber = CreateFiber(
-          0, [](void *p) { (*static_cast<std::packaged_task<void()> *>(p))(); },
-          co_bind.get());
-
-      std::get<_CoPtr>(co) = _CoPtr(fiber, [](void *p) { DeleteFiber(p); });
+      co_bind = std::make_unique<_SubEntry>(
+          std::packaged_task<void()>(std::bind(std::get<_CoSubFunc>(co),
+                                               &sub_helper,
+                                               std::get<_CoUserPtr>(co))),
+          &sub_helper);
+
+      std::get<_CoPtr>(co) = std::make_unique<CoContext>(
+          [](void *p) {
+            auto entry = static_cast<_SubEntry *>(p);
+            entry->task();
+            // 子协程函数返回后不会再被切回
+            for (;;)
+              entry->helper->SwitchToMain();
+          },
+          co_bind.get(), _stack_size);
     }
 
-    auto main_fiber =
-        std::unique_ptr<void, decltype([](void *) { ConvertFiberToThread(); })>(
-            ConvertThreadToFiber(nullptr));
     CoMainHelper main_helper(_co_subs);
-    std::get<_CoPtr>(_co_main) = _CoPtr(main_fiber.get(), [](void *) {});
     std::get<_CoMainFunc>(_co_main)(&main_helper,
                                     std::get<_CoUserPtr>(_co_main));
+    for (auto &co : _co_subs)
+      std::get<_CoPtr>(co).reset();
+
+    std::get<_CoPtr>(_co_main).reset();
   }
 
+  struct _SubEntry {
+    std::packaged_task<void()> task;
+    CoSubHelper *helper{nullptr};
+  };
+
 private:
   _CoMain _co_main;
   std::vector<_CoSub> _co_subs;
+  size_t _stack_size{co_default_stack_size};
   std::future<void> _runtime;
 };
 } // namespace byfxxm
@@ -0,0 +1,239 @@
+﻿#ifndef _BYFXXM_CORO_CONTEXT_HPP_
+#define _BYFXXM_CORO_CONTEXT_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Windows下使用纤程，x86-64下直接切换寄存器和栈，其它平台使用ucontext
+// 定义BYFXXM_CORO_UCONTEXT时在x86-64下也使用ucontext
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#if !defined(__x86_64__) || defined(BYFXXM_CORO_UCONTEXT)
+#include <ucontext.h>
+#define byfxxm_CoroUcontext
+#endif
+#endif
+
+namespace byfxxm {
+using CoEntry = void (*)(void *);
+inline constexpr size_t co_default_stack_size = 256 * 1024;
+
+#if !defined(_WIN32)
+// 协程栈，低地址一侧有一页不可访问的保护页，栈溢出时立即出错
+struct CoStack {
+  void *base{nullptr}; // 含保护页
+  size_t size{0};      // 含保护页
+
+  void *Top() const { return static_cast<char *>(base) + size; }
+};
+
+// 复用已释放的协程栈，避免每次启动流水线都mmap、munmap
+class CoStackPool {
+public:
+  static CoStackPool &Instance() {
+    static CoStackPool pool;
+    return pool;
+  }
+
+  ~CoStackPool() {
+    for (auto &stack : _free)
+      munmap(stack.base, stack.size);
+  }
+
+  // size向上取整到页，另加一页保护页
+  CoStack Acquire(size_t size) {
+    static const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (size + page - 1) / page * page + page;
+    {
+      std::lock_guard lock(_mutex);
+      for (auto iter = _free.begin(); iter != _free.end(); ++iter) {
+        if (iter->size == size) {
+          auto stack = *iter;
+          _free.erase(iter);
+          return stack;
+        }
+      }
+    }
+
+    auto base = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+      throw std::bad_alloc();
+
+    if (mprotect(base, page, PROT_NONE) != 0) {
+      munmap(base, size);
+      throw std::bad_alloc();
+    }
+
+    return {base, size};
+  }
+
+  void Release(const CoStack &stack) {
+    {
+      std::lock_guard lock(_mutex);
+      if (_free.size() < _max_free) {
+        _free.push_back(stack);
+        return;
+      }
+    }
+
+    munmap(stack.base, stack.size);
+  }
+
+private:
+  static constexpr size_t _max_free = 256;
+  std::mutex _mutex;
+  std::vector<CoStack> _free;
+};
+#endif
+
+#if !defined(_WIN32) && !defined(byfxxm_CoroUcontext)
+// 保存callee-saved寄存器、MXCSR和x87控制字后换栈
+[[gnu::naked, gnu::noinline]] inline void _CoSwitchStack(void ** /*from*/,
+                                                         void * /*to*/) {
+  asm volatile(R"(
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+  )");
+}
+
+// 新协程第一次切入时从这里开始，r12为参数，r13为入口
+[[gnu::naked, gnu::noinline]] inline void _CoTrampoline() {
+  asm volatile(R"(
+    movq %r12, %rdi
+    callq *%r13
+    ud2
+  )");
+}
+#endif
+
+// 一个协程的执行上下文，同一线程中的上下文之间用Resume切换
+// 默认构造的上下文代表当前线程本身，必须先于其它上下文创建、后于其它上下文销毁
+class CoContext {
+public:
+  CoContext() {
+#if defined(_WIN32)
+    _fiber = ConvertThreadToFiber(nullptr);
+#endif
+    _current = this;
+  }
+
+  // entry不能返回，结束时须切换到其它上下文且不再被切回
+  CoContext(CoEntry entry, void *arg,
+            size_t stack_size = co_default_stack_size)
+      : _entry(entry), _arg(arg) {
+#if defined(_WIN32)
+    _fiber = CreateFiber(stack_size, entry, arg);
+#else
+    _stack = CoStackPool::Instance().Acquire(stack_size);
+#if defined(byfxxm_CoroUcontext)
+    getcontext(&_uc);
+    _uc.uc_stack.ss_sp = _stack.base;
+    _uc.uc_stack.ss_size = _stack.size;
+    _uc.uc_link = nullptr;
+    makecontext(&_uc, &CoContext::_UcStart, 0);
+#else
+    // 栈顶向下：对齐填充、返回地址、rbp、rbx、r12、r13、r14、r15、控制字
+    auto ret = reinterpret_cast<uintptr_t *>(_stack.Top()) - 3;
+    ret[0] = reinterpret_cast<uintptr_t>(&_CoTrampoline);
+    ret[-1] = 0;
+    ret[-2] = 0;
+    ret[-3] = reinterpret_cast<uintptr_t>(this);
+    ret[-4] = reinterpret_cast<uintptr_t>(&CoContext::_Start);
+    ret[-5] = 0;
+    ret[-6] = 0;
+    ret[-7] = uintptr_t{0x037f} << 32 | 0x1f80;
+    _sp = ret - 7;
+#endif
+#endif
+  }
+
+  ~CoContext() {
+#if defined(_WIN32)
+    if (_entry)
+      DeleteFiber(_fiber);
+    else
+      ConvertFiberToThread();
+#else
+    if (_entry)
+      CoStackPool::Instance().Release(_stack);
+#endif
+    if (_current == this)
+      _current = nullptr;
+  }
+
+  CoContext(const CoContext &) = delete;
+  CoContext &operator=(const CoContext &) = delete;
+
+  // 从当前上下文切换到本上下文
+  void Resume() {
+    auto from = _current;
+    _current = this;
+#if defined(_WIN32)
+    (void)from;
+    SwitchToFiber(_fiber);
+#elif defined(byfxxm_CoroUcontext)
+    swapcontext(&from->_uc, &_uc);
+#else
+    _CoSwitchStack(&from->_sp, _sp);
+#endif
+  }
+
+  static CoContext *Current() { return _current; }
+
+private:
+#if !defined(_WIN32)
+  static void _Start(CoContext *self) {
+    self->_entry(self->_arg);
+    std::abort();
+  }
+
+#if defined(byfxxm_CoroUcontext)
+  // makecontext只能可移植地传递int参数，改从_current取得
+  static void _UcStart() { _Start(_current); }
+#endif
+#endif
+
+private:
+  CoEntry _entry{nullptr};
+  void *_arg{nullptr};
+#if defined(_WIN32)
+  void *_fiber{nullptr};
+#else
+  CoStack _stack;
+#if defined(byfxxm_CoroUcontext)
+  ucontext_t _uc;
+#else
+  void *_sp{nullptr};
+#endif
+#endif
+  static inline thread_local CoContext *_current{nullptr};
+};
+} // namespace byfxxm
+
+#endif
@@ -12,40 +12,58 @@ struct SnapshotHelper {
   const MarkSnapshot &mark_snapshot;
   const GotoSnapshot &goto_snapshot;
   const SnapshotTable &snapshot_table;
+  const CallSubprogram &call_subprogram;
 };
 
-class Ginterface;
-class Abstree {
-public:
-  struct Node;
-  using NodePtr = UniquePtr<Node>;
+template <class F, class... Args>
+concept _NumericFunc = requires(const std::decay_t<F> func, Args... args) {
+  { func(args...) } -> std::same_as<double>;
+};
+
+template <class F, class... Args>
+concept _BooleanFunc = requires(const std::decay_t<F> func, Args... args) {
+  { func(args...) } -> std::same_as<bool>;
+};
 
-  struct Node {
-    Predicate pred;
-    std::pmr::vector<NodePtr> subs{&mempool};
-  };
+namespace abstree {
+struct Node;
+using NodePtr = UniquePtr<Node>;
+
+// 语法树节点与指令处理类型无关
+struct Node {
+  Predicate pred;
+  std::pmr::vector<NodePtr> subs{&Mempool()};
+  Vtype type{Vtype::GENERIC};
+};
+} // namespace abstree
+
+template <GinterfaceConcept G> class BasicAbstree {
+public:
+  using Node = abstree::Node;
+  using NodePtr = abstree::NodePtr;
 
-  Abstree(NodePtr &root, Value &rval, Address *addr, Ginterface *gimpl,
-          const SnapshotHelper &helper) noexcept
+  BasicAbstree(NodePtr &root, Value &rval, Address *addr, G *gimpl,
+               const SnapshotHelper &helper) noexcept
       : _root(&root), _return_val(rval), _addr(addr), _gimpl(gimpl),
         _snapshot_helper(helper) {
     assert(*std::get<NodePtr *>(_root));
   }
 
-  Abstree(NodePtr &&root, Value &rval, Address *addr, Ginterface *gimpl,
-          const SnapshotHelper &helper) noexcept
+  BasicAbstree(NodePtr &&root, Value &rval, Address *addr, G *gimpl,
+               const SnapshotHelper &helper) noexcept
       : _root(std::move(root)), _return_val(rval), _addr(addr), _gimpl(gimpl),
         _snapshot_helper(helper) {
     assert(std::get<NodePtr>(_root));
   }
 
-  ~Abstree() = default;
-  Abstree(const Abstree &) = delete;
-  Abstree(Abstree &&) noexcept = default;
-  Abstree &operator=(const Abstree &) = delete;
-  Abstree &operator=(Abstree &&) noexcept = default;
+  ~BasicAbstree() = default;
+  BasicAbstree(const BasicAbstree &) = delete;
+  BasicAbstree(BasicAbstree &&) noexcept = default;
+  BasicAbstree &operator=(const BasicAbstree &) = delete;
+  BasicAbstree &operator=(BasicAbstree &&) noexcept = default;
 
   Value operator()() const {
+    byfxxm_StatsTime(abstree);
     try {
       std::visit(
           Overloaded{
@@ -64,7 +82,126 @@ private:
     if (std::holds_alternative<Value>(node->pred))
       return std::get<Value>(node->pred);
 
-    std::pmr::vector<Value> params{&mempool};
+    switch (node->type) {
+    case Vtype::NUMERIC:
+      // #变量需保留左值，走通用路径
+      if (!std::holds_alternative<Sharp>(node->pred))
+        return _ExecuteNumeric(node);
+      break;
+    case Vtype::BOOLEAN:
+      return _ExecuteBoolean(node);
+    default:
+      break;
+    }
+
+    return _ExecuteGeneric(node);
+  }
+
+  // 纯数值子树，全程以double计算，不经过Value
+  double _ExecuteNumeric(const NodePtr &node) const {
+    return std::visit(
+        Overloaded{
+            [](const Value &value) { return std::get<double>(value); },
+            [&](const Unary &unary) {
+              return std::visit(
+                  [&](auto &&func) -> double {
+                    if constexpr (_NumericFunc<decltype(func), double>)
+                      return func(_Number(node->subs[0]));
+                    else
+                      return _ToDouble(_ExecuteGeneric(node));
+                  },
+                  unary);
+            },
+            [&](const Binary &binary) {
+              return std::visit(
+                  [&](auto &&func) -> double {
+                    if constexpr (_NumericFunc<decltype(func), double, double>)
+                      return func(_Number(node->subs[0]),
+                                  _Number(node->subs[1]));
+                    else
+                      return _ToDouble(_ExecuteGeneric(node));
+                  },
+                  binary);
+            },
+            [&](const Sharp &sharp) {
+              return std::visit(
+                  [&](auto &&func) -> double {
+                    return func(_Number(node->subs[0]), _addr);
+                  },
+                  sharp);
+            },
+            [&](const auto &) { return _ToDouble(_ExecuteGeneric(node)); },
+        },
+        node->pred);
+  }
+
+  // 纯布尔子树，操作数为纯数值时直接比较
+  bool _ExecuteBoolean(const NodePtr &node) const {
+    auto is = [&](size_t index, Vtype type) {
+      return node->subs[index]->type == type;
+    };
+
+    return std::visit(
+        Overloaded{
+            [](const Value &value) { return std::get<bool>(value); },
+            [&](const Unary &unary) {
+              return std::visit(
+                  [&](auto &&func) -> bool {
+                    if constexpr (_BooleanFunc<decltype(func), bool>) {
+                      if (is(0, Vtype::BOOLEAN))
+                        return func(_ExecuteBoolean(node->subs[0]));
+                    }
+
+                    return _ToBool(_ExecuteGeneric(node));
+                  },
+                  unary);
+            },
+            [&](const Binary &binary) {
+              return std::visit(
+                  [&](auto &&func) -> bool {
+                    if constexpr (_BooleanFunc<decltype(func), double,
+                                               double>) {
+                      if (is(0, Vtype::NUMERIC) && is(1, Vtype::NUMERIC))
+                        return func(_ExecuteNumeric(node->subs[0]),
+                                    _ExecuteNumeric(node->subs[1]));
+                    }
+
+                    return _ToBool(_ExecuteGeneric(node));
+                  },
+                  binary);
+            },
+            [&](const auto &) { return _ToBool(_ExecuteGeneric(node)); },
+        },
+        node->pred);
+  }
+
+  double _Number(const NodePtr &node) const {
+    if (node->type == Vtype::NUMERIC)
+      return _ExecuteNumeric(node);
+
+    return _ToDouble(_Execute(node));
+  }
+
+  static double _ToDouble(const Value &value) {
+    return std::visit(
+        [](auto &&v) -> double {
+          if constexpr (byfxxm_CanConvertToDouble(v))
+            return v;
+          else
+            throw AbstreeException("numeric error");
+        },
+        value);
+  }
+
+  static bool _ToBool(const Value &value) {
+    if (!std::holds_alternative<bool>(value))
+      throw AbstreeException("boolean error");
+
+    return std::get<bool>(value);
+  }
+
+  Value _ExecuteGeneric(const NodePtr &node) const {
+    std::pmr::vector<Value> params{&Mempool()};
     std::ranges::for_each(node->subs,
                           [&](auto &&p) { params.push_back(_Execute(p)); });
 
@@ -92,7 +229,8 @@ private:
               return std::visit(
                   [&](auto &&func) {
                     return func(params, _addr, _gimpl,
-                                _snapshot_helper.mark_snapshot);
+                                _snapshot_helper.mark_snapshot,
+                                _snapshot_helper.call_subprogram);
                   },
                   gcmd);
             },
@@ -113,11 +251,12 @@ private:
   std::variant<NodePtr, NodePtr *> _root;
   Value &_return_val;
   Address *_addr{nullptr};
-  Ginterface *_gimpl{nullptr};
+  G *_gimpl{nullptr};
   SnapshotHelper _snapshot_helper;
 };
 
-using Segment = std::tuple<Abstree::NodePtr, Snapshot>;
+using Abstree = BasicAbstree<Ginterface>;
+using Segment = std::tuple<abstree::NodePtr, Snapshot>;
 } // namespace byfxxm
 
 #endif
@@ -2,13 +2,18 @@
 #define _BYFXXM_ADDRESS_HPP_
 
 #include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace byfxxm {
 class Address {
 public:
   using _Key = double;
   using _Value = SharpValue;
+  using Values = std::vector<std::pair<_Key, double>>;
 
   Address() = default;
 
@@ -18,23 +23,142 @@ public:
     }
   }
 
+  // 以base为底层的写时复制视图，首次访问时从base复制，Commit前不影响base
+  // base中GetSet绑定的变量，视图内首次读到的值在整个视图期间保持不变
+  explicit Address(Address *base) : _base(base) {}
+
   [[nodiscard]] _Value &operator[](const _Key &key) {
-    if (_dict.find(key) == _dict.end()) {
-      auto point = std::make_unique<double>(nan);
-      Insert(key, _Value(point.get()));
-      _buffer.push_back(std::move(point));
+    byfxxm_StatsCount(lookups);
+    if (!_frames.empty() && _IsLocal(key))
+      return _frames.back()->sharps[static_cast<size_t>(key) - 1];
+
+    if (auto iter = _dict.find(key); iter != _dict.end())
+      return iter->second;
+
+    if (_base) {
+      if (auto iter = _base->_dict.find(key); iter != _base->_dict.end())
+        return _Copy(key, iter->second);
     }
 
-    return _dict.at(key);
+    return _NewValue(key, nan);
   }
 
   void Insert(const _Key &key, const _Value &sharp) {
+    byfxxm_StatsCount(inserts);
     _dict.insert(std::make_pair(key, sharp));
   }
 
+  // G65调用时压入新的一层局部变量#1~#33，初值为空，返回时弹出
+  // 没有压入任何层时，局部变量与其它#变量存放在一起
+  void PushFrame() { _frames.push_back(std::make_unique<_Frame>()); }
+  void PopFrame() { _frames.pop_back(); }
+  size_t Depth() const { return _frames.size(); }
+
+  // 普通#变量的当前值，不含GetSet绑定的变量
+  Values Dump() const {
+    Values ret;
+    ret.reserve(_dict.size());
+    for (auto &[key, sharp] : _dict) {
+      if (!sharp.IsGetSet())
+        ret.emplace_back(key, sharp);
+    }
+
+    return ret;
+  }
+
+  // 视图中读过的GetSet变量，base中的当前值是否已经变化
+  bool Changed() const {
+    return std::ranges::any_of(_watches, [](auto &&pair) {
+      auto &watch = pair.second;
+      double now = watch.source;
+      return watch.read &&
+             !(now == watch.observed || (IsNaN(now) && IsNaN(watch.observed)));
+    });
+  }
+
+  // 把视图中的修改写回base，GetSet变量只写回视图中赋过值的
+  void Commit() {
+    for (auto &[key, sharp] : _dict) {
+      if (auto iter = _watches.find(key); iter != _watches.end()) {
+        if (iter->second.written)
+          (*_base)[key] = iter->second.value;
+      } else if (!sharp.IsGetSet()) {
+        (*_base)[key] = static_cast<double>(sharp);
+      }
+    }
+  }
+
+  // 丢弃视图中的全部内容
+  void Reset() {
+    _dict.clear();
+    _buffer.clear();
+    _watches.clear();
+    _frames.clear();
+  }
+
+private:
+  static constexpr size_t _locals = 33;
+
+  struct _Frame {
+    _Frame() {
+      values.fill(nan);
+      for (size_t i = 0; i < _locals; ++i)
+        sharps.emplace_back(&values[i]);
+    }
+
+    std::array<double, _locals> values;
+    std::vector<_Value> sharps;
+  };
+
+  static bool _IsLocal(const _Key &key) {
+    return key >= 1 && key <= _locals && key == static_cast<size_t>(key);
+  }
+
+  struct _Watch {
+    SharpValue source;
+    double observed{nan};
+    double value{nan};
+    bool read{false};
+    bool written{false};
+  };
+
+  _Value &_NewValue(const _Key &key, double value) {
+    auto point = std::make_unique<double>(value);
+    Insert(key, _Value(point.get()));
+    _buffer.push_back(std::move(point));
+    return _dict.at(key);
+  }
+
+  _Value &_Copy(const _Key &key, const _Value &sharp) {
+    if (!sharp.IsGetSet())
+      return _NewValue(key, sharp);
+
+    auto &watch = _watches.emplace(key, _Watch{sharp}).first->second;
+    Insert(key, _Value(SharpValue::GetSet{
+                    [&watch]() {
+                      if (watch.written)
+                        return watch.value;
+
+                      if (!watch.read) {
+                        watch.observed = watch.source;
+                        watch.read = true;
+                      }
+
+                      return watch.observed;
+                    },
+                    [&watch](double value) {
+                      watch.value = value;
+                      watch.written = true;
+                    }}));
+    return _dict.at(key);
+  }
+
 private:
   std::unordered_map<_Key, _Value> _dict;
   std::vector<std::unique_ptr<double>> _buffer;
+  Address *_base{nullptr};
+  std::unordered_map<_Key, _Watch> _watches;
+  std::vector<std::unique_ptr<_Frame>> _frames;
 };
 } // namespace byfxxm
 
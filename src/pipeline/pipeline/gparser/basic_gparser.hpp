@@ -0,0 +1,252 @@
+﻿#ifndef _BYFXXM_BASIC_GPARSER_HPP_
+#define _BYFXXM_BASIC_GPARSER_HPP_
+
+#include "address.hpp"
+#include "checkpoint.hpp"
+#include "cursor.hpp"
+#include "ginterface.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "syntax.hpp"
+#include "validator.hpp"
+#include <atomic>
+
+namespace byfxxm {
+using UpdateSnapshot = std::function<void(const Snapshot &)>;
+
+// 流和指令处理类型都在编译期确定，从词法到调用G指令全程没有虚函数
+// G为具体类型时，Gcmd直接调用其成员函数
+template <StreamConcept T, GinterfaceConcept G = Ginterface>
+class BasicGparser {
+public:
+  BasicGparser(T &&stream) : _stream(std::move(stream)) {}
+
+  std::optional<std::string> Run(Address *addr, G *gimpl,
+                                 const UpdateSnapshot &update = {}) noexcept {
+    byfxxm_StatsScope(&_stats);
+    return _Run(addr, gimpl, update, nullptr, 0);
+  }
+
+  // 从不超过line的最近检查点恢复，快进至line行，期间不调用G指令
+  std::optional<std::string>
+  RunFrom(Address *addr, G *gimpl, const Checkpoints &checkpoints, size_t line,
+          const UpdateSnapshot &update = {}) noexcept {
+    byfxxm_StatsScope(&_stats);
+    return _Run(addr, gimpl, update, &checkpoints, line);
+  }
+
+  // 预执行模式，在addr的写时复制视图上一次预执行depth条顶层语句，缓存G指令
+  // 提交时视图中读过的GetSet变量若已变化，丢弃视图从窗口起点重新执行
+  // 窗口在行首结束，多次重新执行后仍在变化则逐条执行并提交
+  std::optional<std::string> RunSpeculative(Address *addr, G *gimpl,
+                                            size_t depth) noexcept {
+    byfxxm_StatsScope(&_stats);
+    std::optional<std::string> ret;
+    try {
+      Address overlay(addr);
+      BlockCollector collector;
+      Syntax<T> syn(std::move(_stream), &overlay, &collector, _on_comment);
+      syn.SetSubprograms(_subprograms);
+      _Speculate(syn, overlay, collector, addr, gimpl,
+                 std::max<size_t>(depth, 1));
+    } catch (const ParseException &ex) {
+      ret = std::format("#error: {}", ex.what());
+    }
+
+    return ret;
+  }
+
+  // 拉模式，每次返回下一个段，程序结束或出错时返回空，错误信息写入error
+  // addr在首次调用时绑定，之后传入的addr不再使用
+  std::optional<Gblock> NextBlock(Address *addr,
+                                  std::string *error = nullptr) noexcept {
+    byfxxm_StatsScope(&_stats);
+    try {
+      if (!_cursor)
+        _cursor = std::make_unique<Cursor<T>>(std::move(_stream), addr,
+                                              _subprograms, _on_comment);
+
+      return _cursor->Next();
+    } catch (const ParseException &ex) {
+      if (error)
+        *error = std::format("#error: {}", ex.what());
+    }
+
+    return {};
+  }
+
+  // 校验模式，只解析不执行，返回全部错误
+  Diagnostics Validate() noexcept {
+    byfxxm_StatsScope(&_stats);
+    return Validator<T>(std::move(_stream))();
+  }
+
+  // Run时按Checkpoints的策略记录检查点
+  void SetCheckpoints(Checkpoints *checkpoints) { _checkpoints = checkpoints; }
+
+  // Run时按源码行统计执行次数和耗时，子程序中的语句不统计
+  void SetProfiler(Profiler *profiler) { _profiler = profiler; }
+
+  // Run时解析与执行分别在两个线程中进行，不支持子程序调用
+  void SetParallel(bool parallel) { _parallel = parallel; }
+
+  // M98/G65调用的子程序，按O号查找
+  void SetSubprograms(const Subprograms *subprograms) {
+    _subprograms = subprograms;
+  }
+
+  // 执行时读到注释就回调，并行模式下在解析线程中回调
+  void SetOnComment(const OnComment &on_comment) { _on_comment = on_comment; }
+
+  // 解析统计，未定义BYFXXM_GPARSER_STATS时全为0
+  const Stats &GetStats() const { return _stats; }
+
+  // 可在其它线程中调用，Run等在当前语句执行完后返回，不报错
+  void Stop() { _stop.store(true, std::memory_order_relaxed); }
+
+private:
+  std::optional<std::string> _Run(Address *addr, G *gimpl,
+                                  const UpdateSnapshot &update,
+                                  const Checkpoints *from,
+                                  size_t line) noexcept {
+    std::optional<std::string> ret;
+    try {
+      if (_parallel) {
+        ParallelSyntax<T, G> syn(std::move(_stream), addr, gimpl,
+                                 _on_comment);
+        _Loop(syn, addr, update, from, line);
+      } else {
+        Syntax<T, G> syn(std::move(_stream), addr, gimpl, _on_comment);
+        syn.SetSubprograms(_subprograms);
+        _Loop(syn, addr, update, from, line);
+      }
+    } catch (const ParseException &ex) {
+      ret = std::format("#error: {}", ex.what());
+    }
+
+    return ret;
+  }
+
+  void _Speculate(Syntax<T> &syn, Address &overlay, BlockCollector &collector,
+                  Address *addr, G *gimpl, size_t depth) {
+    // 变量一直在变时不再预执行，从窗口起点逐条执行并立即提交，与Run相同
+    constexpr size_t max_retries = 3;
+    size_t count = 0;
+    size_t retries = 0;
+    size_t line = 0; // 上一条语句所在行
+    bool direct = false;
+    Snapshot start;
+    SnapshotTable table;
+    auto commit = [&]() {
+      overlay.Commit();
+      overlay.Reset();
+      collector.Flush(gimpl, addr);
+    };
+
+    for (;;) {
+      if (_Stopped())
+        return;
+
+      // Restore回到行首，窗口只在新的一行开始，同一行中;分隔的语句不会被拆开
+      auto top = syn.AtTopLevel();
+      auto abstree = syn.Next();
+      if (!abstree ||
+          (top && count >= depth && std::get<1>(*abstree).line != line)) {
+        if (!direct && overlay.Changed()) {
+          direct = ++retries > max_retries;
+          count = 0;
+          overlay.Reset();
+          collector.Blocks().clear();
+          syn.Restore(start, table);
+          continue;
+        }
+
+        if (!direct)
+          commit();
+
+        count = 0;
+        retries = 0;
+        direct = false;
+        if (!abstree)
+          break;
+      }
+
+      auto &[tree, snapshot] = abstree.value();
+      if (count++ == 0) {
+        start = snapshot;
+        table = syn.GetSnapshotTable();
+      }
+
+      line = snapshot.line;
+      collector.SetSnapshot(snapshot);
+      tree();
+      if (direct)
+        commit();
+    }
+  }
+
+  template <class S>
+  void _Loop(S &syn, Address *addr, const UpdateSnapshot &update,
+             const Checkpoints *from, size_t line) {
+    if (from) {
+      if (auto cp = from->Restore(line, addr))
+        syn.Restore(cp->snapshot, cp->snapshot_table);
+
+      syn.FastForward(line);
+    }
+
+    size_t last_line = 0;
+    size_t reached = 0; // 已执行过的主程序最大行号
+    for (;;) {
+      if (_Stopped())
+        break;
+
+      auto top = syn.AtTopLevel();
+      auto sampled = _profiler && _profiler->Due();
+      auto start = sampled ? stats::Ticks() : 0;
+      auto abstree = syn.Next();
+      if (!abstree)
+        break;
+
+      auto &[tree, snapshot] = abstree.value();
+      // 子程序中的行号属于子程序的源码，按调用处所在行计，不回调、不统计
+      auto caller = syn.CallerLine();
+      auto main_line = caller ? caller : snapshot.line;
+      if (_checkpoints && addr && main_line != last_line &&
+          (top || syn.AtBlockHead(snapshot)))
+        _checkpoints->Record(snapshot, syn.GetSnapshotTable(), *addr, reached);
+
+      last_line = main_line;
+      reached = std::max(reached, main_line);
+      if (update && !caller && reached >= line)
+        update(snapshot);
+
+      if (!_profiler || caller) {
+        tree();
+        continue;
+      }
+
+      auto block = syn.BlockLine();
+      tree();
+      _profiler->Count(snapshot.line);
+      if (sampled)
+        _profiler->Sample(snapshot.line, block, stats::Ticks() - start);
+    }
+  }
+
+  bool _Stopped() const { return _stop.load(std::memory_order_relaxed); }
+
+private:
+  T _stream;
+  std::unique_ptr<Cursor<T>> _cursor;
+  Checkpoints *_checkpoints{nullptr};
+  Profiler *_profiler{nullptr};
+  bool _parallel{false};
+  const Subprograms *_subprograms{nullptr};
+  OnComment _on_comment;
+  Stats _stats;
+  std::atomic<bool> _stop{false};
+};
+} // namespace byfxxm
+
+#endif
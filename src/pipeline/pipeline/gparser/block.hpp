@@ -15,6 +15,9 @@ class Block {
 public:
   virtual ~Block() = default;
   virtual Segment *Next() = 0;
+
+  // 回到未执行状态，以便再次执行
+  virtual void Reset() = 0;
 };
 } // namespace block
 
@@ -39,15 +42,22 @@ inline Segment *GetSegment(Scope &scope, size_t &index) {
                     scope[index]);
 };
 
+inline void ResetScope(Scope &scope) {
+  for (auto &stmt : scope) {
+    if (auto block = std::get_if<UniquePtr<block::Block>>(&stmt))
+      (*block)->Reset();
+  }
+}
+
 namespace block {
 class IfElse : public Block {
   struct If {
     Segment cond;
-    Scope scope{&mempool};
+    Scope scope{&Mempool()};
   };
 
   struct Else {
-    Scope scope{&mempool};
+    Scope scope{&Mempool()};
   };
 
   IfElse(const GetRetVal &func) : _get_ret_val_func(func) {}
@@ -89,7 +99,17 @@ class IfElse : public Block {
     return GetSegment(_ifs[_cur_if].scope, _scope_index);
   }
 
-  std::pmr::vector<If> _ifs{&mempool};
+  virtual void Reset() override {
+    for (auto &if_ : _ifs)
+      ResetScope(if_.scope);
+
+    ResetScope(_else.scope);
+    _cur_if = 0;
+    _iscond = true;
+    _scope_index = 0;
+  }
+
+  std::pmr::vector<If> _ifs{&Mempool()};
   Else _else;
   size_t _cur_if{0};
   bool _iscond{true};
@@ -108,6 +128,8 @@ class While : public Block {
     }
 
     if (_scope_index == _scope.size()) {
+      // 内层代码块每轮循环都要重新执行
+      ResetScope(_scope);
       _scope_index = 0;
       return &_cond;
     }
@@ -119,14 +141,22 @@ class While : public Block {
       auto cond = std::get<bool>(_get_ret_val_func());
       if (!cond)
         return {};
+
+      byfxxm_StatsCount(iterations);
     }
 
     _iscond = false;
     return GetSegment(_scope, _scope_index);
   }
 
+  virtual void Reset() override {
+    ResetScope(_scope);
+    _iscond = true;
+    _scope_index = 0;
+  }
+
   Segment _cond;
-  Scope _scope{&mempool};
+  Scope _scope{&Mempool()};
   bool _iscond{true};
   GetRetVal _get_ret_val_func;
   size_t _scope_index{0};
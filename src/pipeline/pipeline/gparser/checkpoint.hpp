@@ -0,0 +1,83 @@
+﻿#ifndef _BYFXXM_CHECKPOINT_HPP_
+#define _BYFXXM_CHECKPOINT_HPP_
+
+#include "address.hpp"
+#include "common.hpp"
+#include <vector>
+
+namespace byfxxm {
+// 检查点记录在顶层语句或最外层WHILE每轮开始处，恢复时从该行重新进入代码块
+struct Checkpoint {
+  Snapshot snapshot;
+  SnapshotTable snapshot_table;
+  Address::Values delta; // 相对上一个检查点变化的#变量
+  size_t reached{0};     // 此前执行过的最大行号
+};
+
+class Checkpoints {
+public:
+  // 每隔statements条语句或bytes个字节记录一次，为0表示不按该条件记录
+  Checkpoints(size_t statements, int64_t bytes = 0)
+      : _statements(statements), _bytes(bytes) {}
+
+  // reached为此前执行过的最大行号，循环中行号会重复
+  void Record(const Snapshot &snapshot, const SnapshotTable &table,
+              const Address &addr, size_t reached) {
+    if (!_Due(snapshot))
+      return;
+
+    Checkpoint cp{snapshot, table, {}, reached};
+    for (auto &[key, value] : addr.Dump()) {
+      auto iter = _values.find(key);
+      if (iter != _values.end() &&
+          (iter->second == value || (IsNaN(iter->second) && IsNaN(value))))
+        continue;
+
+      _values[key] = value;
+      cp.delta.emplace_back(key, value);
+    }
+
+    _list.push_back(std::move(cp));
+    _count = 0;
+    _last_pos = snapshot.pos;
+  }
+
+  // 找到首次执行到line之前的最后一个检查点，并把#变量恢复到该点
+  const Checkpoint *Restore(size_t line, Address *addr) const {
+    auto iter = std::ranges::find_if(
+        _list, [&](const Checkpoint &cp) { return cp.reached >= line; });
+    if (iter == _list.begin())
+      return nullptr;
+
+    std::for_each(_list.begin(), iter, [&](const Checkpoint &cp) {
+      for (auto &[key, value] : cp.delta) {
+        (*addr)[key] = value;
+      }
+    });
+
+    return &*std::prev(iter);
+  }
+
+  size_t Size() const { return _list.size(); }
+
+private:
+  bool _Due(const Snapshot &snapshot) {
+    if (_list.empty())
+      return true;
+
+    ++_count;
+    return (_statements > 0 && _count >= _statements) ||
+           (_bytes > 0 && snapshot.pos - _last_pos >= _bytes);
+  }
+
+private:
+  size_t _statements{0};
+  int64_t _bytes{0};
+  size_t _count{0};
+  int64_t _last_pos{0};
+  std::vector<Checkpoint> _list;
+  std::unordered_map<double, double> _values;
+};
+} // namespace byfxxm
+
+#endif
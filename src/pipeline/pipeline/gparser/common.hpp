@@ -1,6 +1,7 @@
 ﻿#ifndef _BYFXXM_TYPEDEFS_HPP_
 #define _BYFXXM_TYPEDEFS_HPP_
 
+#include "stats.hpp"
 #include "token.hpp"
 #include <concepts>
 #include <limits>
@@ -60,6 +61,10 @@ public:
     return *this;
   }
 
+  [[nodiscard]] bool IsGetSet() const {
+    return std::holds_alternative<GetSet>(_value);
+  }
+
 private:
   std::variant<double *, GetSet> _value;
 };
@@ -74,6 +79,11 @@ struct Snapshot {
   int64_t pos{};
 };
 
+struct Location {
+  size_t line{1};
+  size_t column{1};
+};
+
 using GetSnapshot = std::function<Snapshot()>;
 using GotoSnapshot = std::function<void(const Snapshot &)>;
 using MarkSnapshot = std::function<void(double)>;
@@ -150,6 +160,29 @@ inline std::pmr::synchronized_pool_resource mempool;
 #else
 inline thread_local std::pmr::unsynchronized_pool_resource mempool;
 #endif
+
+// 当前线程解析时使用的内存池，为空时使用mempool，见MempoolScope
+inline thread_local std::pmr::memory_resource *current_mempool = nullptr;
+
+// 语法树、代码块等都从这里分配，释放时回到分配时的内存池
+inline std::pmr::memory_resource &Mempool() {
+  return current_mempool ? *current_mempool : mempool;
+}
+
+// 作用域内当前线程的解析从mr分配，mr须比分配出的对象存活得久
+class MempoolScope {
+public:
+  explicit MempoolScope(std::pmr::memory_resource *mr)
+      : _prev(current_mempool) {
+    current_mempool = mr;
+  }
+  ~MempoolScope() { current_mempool = _prev; }
+  MempoolScope(const MempoolScope &) = delete;
+  MempoolScope &operator=(const MempoolScope &) = delete;
+
+private:
+  std::pmr::memory_resource *_prev{nullptr};
+};
 } // namespace byfxxm
 
 #endif
@@ -0,0 +1,111 @@
+﻿#ifndef _BYFXXM_CURSOR_HPP_
+#define _BYFXXM_CURSOR_HPP_
+
+#include "ginterface.hpp"
+#include "syntax.hpp"
+#include <deque>
+
+namespace byfxxm {
+// 一个已解码的运动/指令段
+struct Gblock {
+  predicate::Gfunc func{nullptr}; // 对应的Ginterface接口，如&Ginterface::G1
+  double value{Gtag::default_value};
+  Gparams params;
+  Snapshot snapshot;
+};
+
+// 把G指令缓存为Gblock，稍后再取走或转发
+class BlockCollector : public Ginterface {
+public:
+  // 之后收到的段都记在snapshot所在行
+  void SetSnapshot(const Snapshot &snapshot) { _snapshot = snapshot; }
+
+  std::deque<Gblock> &Blocks() { return _blocks; }
+
+  // 依次转发给gimpl，N标号在收集时已登记过
+  template <GinterfaceConcept G> void Flush(G *gimpl, const Address *addr) {
+    static const MarkSnapshot mark_snapshot = [](double) {};
+    for (auto &block : _blocks) {
+      predicate::Invoke(
+          block.func, gimpl,
+          Ginterface::Utils{block.value, block.params, addr, mark_snapshot});
+    }
+    _blocks.clear();
+  }
+
+  virtual void None(const Utils &utils) override {
+    _Push(&Ginterface::None, utils);
+  }
+  virtual void G0(const Utils &utils) override {
+    _Push(&Ginterface::G0, utils);
+  }
+  virtual void G1(const Utils &utils) override {
+    _Push(&Ginterface::G1, utils);
+  }
+  virtual void G2(const Utils &utils) override {
+    _Push(&Ginterface::G2, utils);
+  }
+  virtual void G3(const Utils &utils) override {
+    _Push(&Ginterface::G3, utils);
+  }
+  virtual void G4(const Utils &utils) override {
+    _Push(&Ginterface::G4, utils);
+  }
+  virtual void Cycle(const Utils &utils) override {
+    _Push(&Ginterface::Cycle, utils);
+  }
+
+  // 段被取走时已经越过该行，N标号必须在此时登记，GOTO才能找到
+  virtual void N(const Utils &utils) override {
+    utils.mark_snapshot(utils.value);
+    _Push(&Ginterface::N, utils);
+  }
+
+private:
+  void _Push(predicate::Gfunc func, const Utils &utils) {
+    _blocks.push_back({func, utils.value, utils.params, _snapshot});
+  }
+
+private:
+  Snapshot _snapshot;
+  std::deque<Gblock> _blocks;
+};
+
+// 拉模式，每次只解析执行到产生下一个段为止
+// 词法、未执行完的代码块和#变量在两次调用之间保持
+template <StreamConcept T> class Cursor {
+public:
+  Cursor(T &&stream, Address *addr, const Subprograms *subprograms = nullptr,
+         const OnComment &on_comment = {})
+      : _syntax(std::move(stream), addr, &_collector, on_comment) {
+    _syntax.SetSubprograms(subprograms);
+  }
+
+  Cursor(const Cursor &) = delete;
+  Cursor &operator=(const Cursor &) = delete;
+
+  std::optional<Gblock> Next() {
+    // 一行可能产生多个段，先缓存起来
+    auto &blocks = _collector.Blocks();
+    while (blocks.empty()) {
+      auto abstree = _syntax.Next();
+      if (!abstree)
+        return {};
+
+      auto &[tree, snapshot] = abstree.value();
+      _collector.SetSnapshot(snapshot);
+      tree();
+    }
+
+    auto block = std::move(blocks.front());
+    blocks.pop_front();
+    return block;
+  }
+
+private:
+  BlockCollector _collector;
+  Syntax<T> _syntax;
+};
+} // namespace byfxxm
+
+#endif
@@ -33,6 +33,37 @@ class AbstreeException : public ParseException {
 public:
   using ParseException::ParseException;
 };
+
+enum class errc {
+  LEX,    // 词法错误
+  SYNTAX, // 语法错误
+  TYPE,   // 类型错误
+};
+
+// 不抛异常的出错路径：函数返回空值，第一个错误记录在ParseError中
+// error为出错原因的静态字符串，不分配内存
+struct ParseError {
+  errc code{errc::SYNTAX};
+  const char *error{nullptr};
+
+  explicit operator bool() const noexcept { return error != nullptr; }
+};
+
+inline constexpr ParseError SyntaxError(const char *reason) {
+  return {errc::SYNTAX, reason};
+}
+
+// 回到抛异常的路径
+[[noreturn]] inline void Throw(const ParseError &err) {
+  switch (err.code) {
+  case errc::LEX:
+    throw LexException(err.error);
+  case errc::TYPE:
+    throw AbstreeException(err.error);
+  default:
+    throw SyntaxException(err.error);
+  }
+}
 } // namespace byfxxm
 
 #endif
@@ -2,14 +2,137 @@
 #define _BYFXXM_GINTERFACE_HPP_
 
 #include "common.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
 #include <ranges>
 #include <vector>
 
 namespace byfxxm {
 class Address;
+
+// 段参数，按源码顺序保存全部地址字，同一字母可以出现多次，如M3 M8、G17 G90
+// 不超过inline_words个时不分配内存
+// 另按字母定长存放每个字母最后一次的值，mask记录出现过的字母，按字母查找为O(1)
+class Gparams {
+public:
+  static constexpr auto first = token::Kind::G;
+  static constexpr auto last = token::Kind::Q;
+  static constexpr size_t capacity =
+      static_cast<size_t>(last) - static_cast<size_t>(first) + 1;
+  static_assert(capacity <= 32);
+  static constexpr size_t inline_words = 16;
+
+  static constexpr bool Contains(token::Kind code) {
+    return code >= first && code <= last;
+  }
+
+  static constexpr uint32_t Bit(token::Kind code) {
+    return 1u << _Index(code);
+  }
+
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Gtag;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = const Gtag &;
+
+    Iterator() = default;
+    Iterator(const Gparams *params, size_t index)
+        : _params(params), _index(index) {}
+
+    const Gtag &operator*() const { return _params->_Word(_index); }
+
+    Iterator &operator++() {
+      ++_index;
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      auto ret = *this;
+      ++*this;
+      return ret;
+    }
+
+    bool operator==(const Iterator &rhs) const { return _index == rhs._index; }
+
+  private:
+    const Gparams *_params{nullptr};
+    size_t _index{0};
+  };
+
+  void Set(const Gtag &tag) {
+    assert(Contains(tag.code));
+    _mask |= Bit(tag.code);
+    _values[_Index(tag.code)] = tag.value;
+    if (_size < inline_words)
+      _words[_size] = tag;
+    else
+      _more.push_back(tag);
+
+    ++_size;
+  }
+
+  bool Has(token::Kind code) const {
+    return Contains(code) && (_mask & Bit(code));
+  }
+
+  // 同一字母出现多次时，任意一次的值为value即可
+  bool Has(token::Kind code, double value) const {
+    if (!Has(code))
+      return false;
+
+    if (_values[_Index(code)] == value)
+      return true;
+
+    return std::ranges::any_of(*this, [&](const Gtag &tag) {
+      return tag.code == code && tag.value == value;
+    });
+  }
+
+  // 调用前应先用Has判断，同一字母出现多次时为最后一次的值
+  double operator[](token::Kind code) const {
+    assert(Has(code));
+    return _values[_Index(code)];
+  }
+
+  double Get(token::Kind code, double def) const {
+    return Has(code) ? _values[_Index(code)] : def;
+  }
+
+  uint32_t Mask() const { return _mask; }
+  size_t Size() const { return _size; }
+  bool Empty() const { return _size == 0; }
+
+  // 按源码顺序遍历全部地址字，包括重复的字母
+  Iterator begin() const { return {this, 0}; }
+  Iterator end() const { return {this, _size}; }
+
+private:
+  static constexpr size_t _Index(token::Kind code) {
+    return static_cast<size_t>(code) - static_cast<size_t>(first);
+  }
+
+  const Gtag &_Word(size_t index) const {
+    return index < inline_words ? _words[index] : _more[index - inline_words];
+  }
+
+private:
+  uint32_t _mask{0};
+  std::array<double, capacity> _values{};
+  size_t _size{0};
+  std::array<Gtag, inline_words> _words{};
+  std::vector<Gtag> _more; // 超过inline_words的部分
+};
+
 class Ginterface {
 public:
-  using Params = std::pmr::vector<Gtag>;
+  using Params = Gparams;
   struct Utils {
     const double value{Gtag::default_value};
     const Params &params;
@@ -25,6 +148,21 @@ public:
   virtual void G3(const Utils &) = 0;
   virtual void G4(const Utils &) = 0;
   virtual void N(const Utils &) = 0;
+  // 固定循环G73、G74、G76、G81~G89，value为循环号，G80取消
+  virtual void Cycle(const Utils &) = 0;
+};
+
+// 编译期已知的指令处理类型，不必继承Ginterface
+template <class T>
+concept GinterfaceConcept = requires(T gimpl, const Ginterface::Utils &utils) {
+  gimpl.None(utils);
+  gimpl.G0(utils);
+  gimpl.G1(utils);
+  gimpl.G2(utils);
+  gimpl.G3(utils);
+  gimpl.G4(utils);
+  gimpl.N(utils);
+  gimpl.Cycle(utils);
 };
 } // namespace byfxxm
 
@@ -1,14 +1,13 @@
 ﻿#ifndef _BYFXXM_GPARSER_HPP_
 #define _BYFXXM_GPARSER_HPP_
 
-#include "address.hpp"
-#include "ginterface.hpp"
-#include "syntax.hpp"
+#include "basic_gparser.hpp"
 
 namespace byfxxm {
+// 擦除流的类型，转发给BasicGparser<T, Ginterface>
 class Gparser {
 public:
-  using UpdateSnapshot = std::function<void(const Snapshot &)>;
+  using UpdateSnapshot = byfxxm::UpdateSnapshot;
 
   template <StreamConcept T>
   Gparser(T &&stream)
@@ -20,40 +19,134 @@ public:
     return _gparser_impl->Run(addr, gimpl, update);
   }
 
+  // 从不超过line的最近检查点恢复，快进至line行，期间不调用Ginterface
+  std::optional<std::string>
+  RunFrom(Address *addr, Ginterface *gimpl, const Checkpoints &checkpoints,
+          size_t line, const UpdateSnapshot &update = {}) noexcept {
+    return _gparser_impl->RunFrom(addr, gimpl, checkpoints, line, update);
+  }
+
+  // 预执行模式，在addr的写时复制视图上一次预执行depth条顶层语句，缓存G指令
+  // 提交时视图中读过的GetSet变量若已变化，丢弃视图从窗口起点重新执行
+  // 窗口在行首结束，多次重新执行后仍在变化则逐条执行并提交
+  std::optional<std::string> RunSpeculative(Address *addr, Ginterface *gimpl,
+                                            size_t depth) noexcept {
+    return _gparser_impl->RunSpeculative(addr, gimpl, depth);
+  }
+
+  // 拉模式，每次返回下一个段，程序结束或出错时返回空，错误信息写入error
+  // addr在首次调用时绑定，之后传入的addr不再使用
+  std::optional<Gblock> NextBlock(Address *addr,
+                                  std::string *error = nullptr) noexcept {
+    return _gparser_impl->NextBlock(addr, error);
+  }
+
+  // 校验模式，只解析不执行，返回全部错误
+  Diagnostics Validate() noexcept { return _gparser_impl->Validate(); }
+
+  // Run时按Checkpoints的策略记录检查点
+  void SetCheckpoints(Checkpoints *checkpoints) {
+    _gparser_impl->SetCheckpoints(checkpoints);
+  }
+
+  // Run时按源码行统计执行次数和耗时
+  void SetProfiler(Profiler *profiler) { _gparser_impl->SetProfiler(profiler); }
+
+  // Run时解析与执行分别在两个线程中进行，不支持子程序调用
+  void SetParallel(bool parallel) { _gparser_impl->SetParallel(parallel); }
+
+  // M98/G65调用的子程序，按O号查找
+  void SetSubprograms(const Subprograms *subprograms) {
+    _gparser_impl->SetSubprograms(subprograms);
+  }
+
+  // 执行时读到注释就回调，并行模式下在解析线程中回调
+  void SetOnComment(const OnComment &on_comment) {
+    _gparser_impl->SetOnComment(on_comment);
+  }
+
+  // 解析统计，未定义BYFXXM_GPARSER_STATS时全为0
+  const Stats &GetStats() const { return _gparser_impl->GetStats(); }
+
+  // 可在其它线程中调用，Run等在当前语句执行完后返回，不报错
+  void Stop() { _gparser_impl->Stop(); }
+
 private:
   class _GparserBase {
   public:
     virtual ~_GparserBase() = default;
     virtual std::optional<std::string> Run(Address *, Ginterface *,
                                            const UpdateSnapshot &) noexcept = 0;
+    virtual std::optional<std::string>
+    RunFrom(Address *, Ginterface *, const Checkpoints &, size_t,
+            const UpdateSnapshot &) noexcept = 0;
+    virtual std::optional<std::string>
+    RunSpeculative(Address *, Ginterface *, size_t) noexcept = 0;
+    virtual std::optional<Gblock> NextBlock(Address *,
+                                            std::string *) noexcept = 0;
+    virtual Diagnostics Validate() noexcept = 0;
+    virtual void SetCheckpoints(Checkpoints *) = 0;
+    virtual void SetProfiler(Profiler *) = 0;
+    virtual void SetParallel(bool) = 0;
+    virtual void SetSubprograms(const Subprograms *) = 0;
+    virtual void SetOnComment(const OnComment &) = 0;
+    virtual const Stats &GetStats() const = 0;
+    virtual void Stop() = 0;
   };
 
   template <StreamConcept T> class _GparserImpl : public _GparserBase {
   public:
-    _GparserImpl(T &&stream) : _stream(std::move(stream)) {}
+    _GparserImpl(T &&stream) : _parser(std::move(stream)) {}
 
     std::optional<std::string>
     Run(Address *addr, Ginterface *gimpl,
         const UpdateSnapshot &update) noexcept override {
-      std::optional<std::string> ret;
-      try {
-        Syntax<T> syn(std::move(_stream), addr, gimpl);
-        while (auto abstree = syn.Next()) {
-          auto &[tree, snapshot] = abstree.value();
-          if (update)
-            update(snapshot);
+      return _parser.Run(addr, gimpl, update);
+    }
 
-          tree();
-        }
-      } catch (const ParseException &ex) {
-        ret = std::format("#error: {}", ex.what());
-      }
+    std::optional<std::string>
+    RunFrom(Address *addr, Ginterface *gimpl, const Checkpoints &checkpoints,
+            size_t line, const UpdateSnapshot &update) noexcept override {
+      return _parser.RunFrom(addr, gimpl, checkpoints, line, update);
+    }
+
+    std::optional<std::string>
+    RunSpeculative(Address *addr, Ginterface *gimpl,
+                   size_t depth) noexcept override {
+      return _parser.RunSpeculative(addr, gimpl, depth);
+    }
 
-      return ret;
+    std::optional<Gblock> NextBlock(Address *addr,
+                                    std::string *error) noexcept override {
+      return _parser.NextBlock(addr, error);
     }
 
+    Diagnostics Validate() noexcept override { return _parser.Validate(); }
+
+    void SetCheckpoints(Checkpoints *checkpoints) override {
+      _parser.SetCheckpoints(checkpoints);
+    }
+
+    void SetProfiler(Profiler *profiler) override {
+      _parser.SetProfiler(profiler);
+    }
+
+    void SetParallel(bool parallel) override { _parser.SetParallel(parallel); }
+
+    void SetSubprograms(const Subprograms *subprograms) override {
+      _parser.SetSubprograms(subprograms);
+    }
+
+    void SetOnComment(const OnComment &on_comment) override {
+      _parser.SetOnComment(on_comment);
+    }
+
+    const Stats &GetStats() const override { return _parser.GetStats(); }
+
+    void Stop() override { _parser.Stop(); }
+
   private:
-    T _stream;
+    BasicGparser<T> _parser;
   };
 
   std::unique_ptr<_GparserBase> _gparser_impl;
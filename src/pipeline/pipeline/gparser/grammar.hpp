@@ -15,6 +15,7 @@ struct Utils {
   const Peek &peek;
   const GetRetVal &get_ret_val;
   const GetSnapshot &get_snapshot;
+  ParseError &error; // 出错时记录第一个错误，各级返回空
 };
 
 inline void SkipNewlines(const Utils &utils) {
@@ -38,6 +39,17 @@ inline constexpr bool IsEndOfFile(const token::Token &tok) {
 
 inline std::optional<Statement> GetStatement(const Utils &);
 
+// 条件表达式必须为布尔值
+inline Abstree::NodePtr Condition(SyntaxNodeList &list, ParseError &err) {
+  auto cond = expr(list, err);
+  if (cond && cond->type == Vtype::NUMERIC) {
+    err = {errc::SYNTAX, "condition error"};
+    return {};
+  }
+
+  return cond;
+}
+
 class Grammar {
 public:
   virtual ~Grammar() = default;
@@ -73,7 +85,11 @@ class Expr : public Grammar {
       list.push_back(utils.get());
     }
 
-    return Statement(Segment(expr(list), utils.get_snapshot()));
+    auto node = expr(list, utils.error);
+    if (utils.error)
+      return {};
+
+    return Statement(Segment(std::move(node), utils.get_snapshot()));
   }
 };
 
@@ -84,12 +100,12 @@ class Ggram : public Grammar {
 
   virtual std::optional<Statement> Rest(SyntaxNodeList &list,
                                         const Utils &utils) const override {
-    SyntaxNodeList gtag{&mempool};
+    SyntaxNodeList gtag{&Mempool()};
     for (;;) {
       auto tok = utils.peek();
       if (IsNewStatement(tok)) {
         if (!gtag.empty())
-          list.push_back(expr(gtag));
+          list.push_back(expr(gtag, utils.error));
         break;
       }
 
@@ -101,14 +117,24 @@ class Ggram : public Grammar {
       if (gtag.empty()) {
         list.push_back(utils.get());
       } else {
-        list.push_back(expr(gtag));
+        list.push_back(expr(gtag, utils.error));
         gtag.clear();
       }
+
+      if (utils.error)
+        return {};
     }
 
-    SyntaxNodeList res{&mempool};
-    res.push_back(gtree(list));
-    return Statement(Segment(expr(res), utils.get_snapshot()));
+    SyntaxNodeList res{&Mempool()};
+    res.push_back(gtree(list, utils.error));
+    if (utils.error)
+      return {};
+
+    auto node = expr(res, utils.error);
+    if (utils.error)
+      return {};
+
+    return Statement(Segment(std::move(node), utils.get_snapshot()));
   }
 };
 
@@ -123,11 +149,13 @@ class IfElse : public Grammar {
     using Else = block::IfElse::Else;
 
     auto read_cond = [&]() -> Segment {
-      SyntaxNodeList list{&mempool};
+      SyntaxNodeList list{&Mempool()};
       for (;;) {
         auto tok = utils.peek();
-        if (tok.kind == token::Kind::NEWLINE)
-          throw SyntaxException();
+        if (tok.kind == token::Kind::NEWLINE || IsEndOfFile(tok)) {
+          utils.error = SyntaxError("missing THEN");
+          return {};
+        }
 
         if (tok.kind == token::Kind::THEN) {
           utils.get();
@@ -137,9 +165,11 @@ class IfElse : public Grammar {
         list.push_back(utils.get());
       }
 
-      return Segment(expr(list), utils.get_snapshot());
+      auto cond = Condition(list, utils.error);
+      return Segment(std::move(cond), utils.get_snapshot());
     };
 
+    // 出错时返回false
     auto read_scope = [&](Scope &scope) {
       for (;;) {
         SkipNewlines(utils);
@@ -154,12 +184,23 @@ class IfElse : public Grammar {
 
         scope.push_back(std::move(stmt.value()));
       }
+
+      return !utils.error;
     };
 
-    // read if
     block::IfElse ifelse(utils.get_ret_val);
-    ifelse._ifs.push_back(If(read_cond()));
-    read_scope(ifelse._ifs.back().scope);
+    auto read_if = [&]() {
+      auto cond = read_cond();
+      if (utils.error)
+        return false;
+
+      ifelse._ifs.push_back(If(std::move(cond)));
+      return read_scope(ifelse._ifs.back().scope);
+    };
+
+    // read if
+    if (!read_if())
+      return {};
 
     // read elseif
     for (;;) {
@@ -168,8 +209,8 @@ class IfElse : public Grammar {
       if (tok.kind != token::Kind::ELSEIF)
         break;
 
-      ifelse._ifs.push_back(If(read_cond()));
-      read_scope(ifelse._ifs.back().scope);
+      if (!read_if())
+        return {};
     }
 
     // read else
@@ -177,15 +218,18 @@ class IfElse : public Grammar {
     if (tok.kind == token::Kind::ELSE) {
       utils.get();
       SkipNewlines(utils);
-      read_scope(ifelse._else.scope);
+      if (!read_scope(ifelse._else.scope))
+        return {};
     }
 
     // endif
     tok = utils.get();
-    if (tok.kind != token::Kind::ENDIF)
-      throw SyntaxException();
+    if (tok.kind != token::Kind::ENDIF) {
+      utils.error = SyntaxError("missing ENDIF");
+      return {};
+    }
 
-    return Statement(MakeUnique<block::IfElse>(mempool, std::move(ifelse)));
+    return Statement(MakeUnique<block::IfElse>(Mempool(), std::move(ifelse)));
   }
 };
 
@@ -197,11 +241,13 @@ class While : public Grammar {
   virtual std::optional<Statement> Rest(SyntaxNodeList &,
                                         const Utils &utils) const override {
     auto read_cond = [&]() -> Segment {
-      SyntaxNodeList list{&mempool};
+      SyntaxNodeList list{&Mempool()};
       for (;;) {
         auto tok = utils.get();
-        if (tok.kind == token::Kind::NEWLINE)
-          throw SyntaxException();
+        if (tok.kind == token::Kind::NEWLINE || IsEndOfFile(tok)) {
+          utils.error = SyntaxError("missing DO");
+          return {};
+        }
 
         if (tok.kind == token::Kind::DO)
           break;
@@ -209,7 +255,8 @@ class While : public Grammar {
         list.push_back(std::move(tok));
       }
 
-      return Segment(expr(list), utils.get_snapshot());
+      auto cond = Condition(list, utils.error);
+      return Segment(std::move(cond), utils.get_snapshot());
     };
 
     auto read_scope = [&](Scope &scope) {
@@ -229,14 +276,21 @@ class While : public Grammar {
 
     block::While wh(utils.get_ret_val);
     wh._cond = read_cond();
+    if (utils.error)
+      return {};
+
     read_scope(wh._scope);
+    if (utils.error)
+      return {};
 
     // end
     auto tok = utils.get();
-    if (tok.kind != token::Kind::END)
-      throw SyntaxException();
+    if (tok.kind != token::Kind::END) {
+      utils.error = SyntaxError("missing END");
+      return {};
+    }
 
-    return Statement(MakeUnique<block::While>(mempool, std::move(wh)));
+    return Statement(MakeUnique<block::While>(Mempool(), std::move(wh)));
   }
 };
 
@@ -249,30 +303,37 @@ using GrammarsList =
     _GrammarsList<grammar::Blank, grammar::Expr, grammar::Ggram,
                   grammar::IfElse, grammar::While>;
 
+// 读到结尾或出错时返回空，出错时错误记录在utils.error中
 inline std::optional<Statement> GetStatement(const Utils &utils) {
   for (;;) {
     auto tok = utils.peek();
     if (IsEndOfFile(tok))
       return {};
 
-    SyntaxNodeList list{&mempool};
+    SyntaxNodeList list{&Mempool()};
     list.push_back(utils.get());
 
     auto iter = std::begin(GrammarsList::grammars);
     for (; iter != std::end(GrammarsList::grammars); ++iter) {
       if (iter->get()->First(tok)) {
         std::optional<Statement> stmt = iter->get()->Rest(list, utils);
+        if (utils.error)
+          return {};
+
         if (!stmt.has_value()) {
           assert(dynamic_cast<grammar::Blank *>(iter->get()));
           break;
         }
 
+        byfxxm_StatsCount(statements);
         return std::move(stmt.value());
       }
     }
 
-    if (iter == std::end(GrammarsList::grammars))
-      throw SyntaxException();
+    if (iter == std::end(GrammarsList::grammars)) {
+      utils.error = SyntaxError("unexpected word");
+      return {};
+    }
   }
 }
 } // namespace grammar
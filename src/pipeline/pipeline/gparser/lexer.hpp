@@ -4,9 +4,15 @@
 #include "exception.hpp"
 #include "token.hpp"
 #include "word.hpp"
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <istream>
+#include <limits>
 #include <optional>
+#include <streambuf>
 #include <string>
+#include <string_view>
 
 namespace byfxxm {
 inline void SkipSpaces(auto &&peek, auto &&get) {
@@ -15,25 +21,73 @@ inline void SkipSpaces(auto &&peek, auto &&get) {
   }
 }
 
-template <StreamConcept T> class Lexer {
+// 注释(...)的内容和所在行，text只在回调期间有效
+using OnComment = std::function<void(std::string_view text, size_t line)>;
+
+inline constexpr char comment_begin = '(';
+inline constexpr char comment_end = ')';
+inline constexpr char percent = '%'; // 程序开始、结束标记，忽略到行尾
+
+// 借派生类取得streambuf受保护的读缓冲区指针，可用于任意streambuf
+class _GetArea : public std::streambuf {
 public:
-  Lexer(T &&stream) : _stream(std::move(stream)) {}
+  static const char *Begin(std::streambuf *buf) {
+    return (buf->*&_GetArea::gptr)();
+  }
 
-  token::Token Get() {
-    _lasttok = Peek();
-    _peektok.reset();
-    return _lasttok.value();
+  static const char *End(std::streambuf *buf) {
+    return (buf->*&_GetArea::egptr)();
   }
 
+  static void Bump(std::streambuf *buf, size_t count) {
+    (buf->*&_GetArea::gbump)(static_cast<int>(count));
+  }
+};
+
+template <StreamConcept T> class Lexer {
+public:
+  Lexer(T &&stream, const OnComment &on_comment = {})
+      : _stream(std::move(stream)), _on_comment(on_comment) {}
+
+  token::Token Get() { return _Take(Peek()); }
+
   token::Token Peek() {
+    if (!_peektok.has_value()) {
+      _peektok = _Scan();
+      if (!_peektok.has_value())
+        throw LexException(_error);
+    }
+
+    return _peektok.value();
+  }
+
+  // 出错时不抛异常，错误记录在Error()中并返回KEOF，让语法分析结束当前语句
+  token::Token TryGet() { return _Take(TryPeek()); }
+
+  token::Token TryPeek() {
     if (!_peektok.has_value())
-      _peektok = _Next();
+      _peektok = _Scan().value_or(token::Token{token::Kind::KEOF, nan});
 
     return _peektok.value();
   }
 
+  // 最近一次词法错误，SkipLine后清除
+  const char *Error() const { return _error; }
+
   auto Tellg() const { return _pos; }
 
+  // 最近一个单词的起始行列，仅在顺序扫描（无Seekg）时有效
+  auto Location() const { return _location; }
+
+  // 丢弃当前行的剩余内容，用于出错后的恢复
+  void SkipLine() {
+    _peektok.reset();
+    _error = nullptr;
+    while (_cursor.column != 1 && !_stream.eof()) {
+      _GetChar();
+    }
+  }
+
   void Seekg(int64_t pos) {
     if (_stream.eof())
       _stream.clear();
@@ -50,6 +104,7 @@ public:
 
       if (_stream.peek() == '\n') {
         _stream.get();
+        ++_pos;
         break;
       }
     }
@@ -59,39 +114,215 @@ public:
   }
 
 private:
-  token::Token _Next() {
+  int _GetChar() {
+    auto ret = _stream.get();
+    _pos += (ret == '\n' ? _NewlineWidth(_pos) : 1);
+    if (ret == '\n') {
+      ++_cursor.line;
+      _cursor.column = 1;
+    } else {
+      ++_cursor.column;
+    }
+
+    return ret;
+  }
+
+  token::Token _Take(const token::Token &tok) {
+    byfxxm_StatsCount(tokens);
+    _lasttok = tok;
+    _peektok.reset();
+    return tok;
+  }
+
+  // 出错时返回空，错误记录在_error中
+  std::optional<token::Token> _Scan() {
+    byfxxm_StatsTime(lexer);
     auto peek = [this]() { return _stream.peek(); };
-    auto get = [this]() {
-      auto ret = _stream.get();
-      _pos += (ret == '\n' ? 2 : 1);
-      return ret;
-    };
+    auto get = [this]() { return _GetChar(); };
     auto last = [this]() -> const std::optional<token::Token> & {
       return _lasttok;
     };
 
-    SkipSpaces(peek, get);
-    if (_stream.eof())
-      return token::Token{token::Kind::KEOF, nan};
+    for (;;) {
+      SkipSpaces(peek, get);
+      _location = _cursor;
+      if (_stream.eof())
+        return token::Token{token::Kind::KEOF, nan};
+
+      if (peek() == comment_begin) {
+        if (!_SkipComment()) {
+          _error = "unterminated comment";
+          return {};
+        }
+
+        continue;
+      }
+
+      if (peek() == percent) {
+        if (_SkipLine())
+          return token::Token{token::Kind::NEWLINE, {}};
+
+        continue;
+      }
+
+      break;
+    }
 
     std::string word;
     word.push_back(get());
 
+    auto matched = false;
     for (const auto &elem : word::WordsList::words) {
-      std::optional<token::Token> tok;
-      if (elem->First(word.front()) &&
-          (tok = elem->Rest(word, {peek, get, last})))
+      if (!elem->First(word.front()))
+        continue;
+
+      matched = true;
+      if (auto tok = elem->Rest(word, {peek, get, last}))
         return tok.value();
     }
 
-    throw LexException();
+    _error = !matched                         ? "unknown character"
+             : token::IsDigit(word.front()) ? "malformed number"
+                                            : "unknown word";
+    return {};
+  }
+
+  // 注释不能跨行，遇到换行或结尾时返回false，换行留给出错后的恢复
+  // 标准输入流在streambuf的读缓冲区中用memchr查找)和换行，注释不跨缓冲区时
+  // 直接把缓冲区中的内容交给回调，跨缓冲区或其它流才拼到_comment中
+  bool _SkipComment() {
+    auto line = _cursor.line;
+    _GetChar();
+    _comment.clear();
+    auto notify = [&](std::string_view text) {
+      if (!_on_comment)
+        return;
+
+      if (_comment.empty()) {
+        _on_comment(text, line);
+      } else {
+        _comment.append(text);
+        _on_comment(_comment, line);
+      }
+    };
+
+    if constexpr (std::derived_from<T, std::istream>) {
+      auto buf = _stream.rdbuf();
+      for (;;) {
+        auto begin = _GetArea::Begin(buf);
+        auto size = static_cast<size_t>(_GetArea::End(buf) - begin);
+        if (size == 0) {
+          auto ch = buf->sgetc();
+          if (ch == std::char_traits<char>::eof() || token::IsNewline(ch))
+            return false;
+
+          // 补充了读缓冲区时重新查找，没有读缓冲区的streambuf逐个字符读取
+          if (_GetArea::Begin(buf) != _GetArea::End(buf))
+            continue;
+
+          buf->sbumpc();
+          ++_pos;
+          ++_cursor.column;
+          if (ch == comment_end) {
+            notify({});
+            return true;
+          }
+
+          if (_on_comment)
+            _comment.push_back(static_cast<char>(ch));
+          continue;
+        }
+
+        auto newline =
+            static_cast<const char *>(std::memchr(begin, '\n', size));
+        auto limit = newline ? static_cast<size_t>(newline - begin) : size;
+        auto close =
+            static_cast<const char *>(std::memchr(begin, comment_end, limit));
+        auto length = close ? static_cast<size_t>(close - begin) : limit;
+        auto consumed = length + (close ? 1 : 0);
+        _pos += consumed;
+        _cursor.column += consumed;
+        if (close) {
+          notify({begin, length});
+          _GetArea::Bump(buf, consumed);
+          return true;
+        }
+
+        if (_on_comment)
+          _comment.append(begin, length);
+        _GetArea::Bump(buf, length);
+        if (newline)
+          return false;
+      }
+    } else {
+      for (;;) {
+        auto ch = _stream.peek();
+        if (_stream.eof() || token::IsNewline(ch))
+          return false;
+
+        _GetChar();
+        if (ch == comment_end)
+          break;
+
+        if (_on_comment)
+          _comment.push_back(static_cast<char>(ch));
+      }
+
+      notify({});
+      return true;
+    }
+  }
+
+  // 忽略到行尾，吃掉换行符时返回true
+  bool _SkipLine() {
+    if constexpr (std::derived_from<T, std::istream>) {
+      _stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+      auto consumed = static_cast<int64_t>(_stream.gcount());
+      if (_stream.eof()) {
+        _pos += consumed;
+        return false;
+      }
+
+      _pos += consumed - 1;
+      _pos += _NewlineWidth(_pos);
+      ++_cursor.line;
+      _cursor.column = 1;
+      return true;
+    } else {
+      while (!_stream.eof() && !token::IsNewline(_stream.peek()))
+        _GetChar();
+
+      return false;
+    }
+  }
+
+  // 换行符在流中实际占的字节数，before为换行符的位置，首次读到换行时由tellg确定
+  // Windows文本模式下CRLF读出为一个\n，占两个字节，其它情况下\r作为普通字符计数
+  // 不支持tellg的流按一个字节计
+  int64_t _NewlineWidth(int64_t before) {
+    if (_newline_width == 0) {
+      _newline_width = 1;
+      if constexpr (requires { _stream.tellg(); }) {
+        auto after = static_cast<int64_t>(_stream.tellg());
+        if (after > before)
+          _newline_width = after - before;
+      }
+    }
+
+    return _newline_width;
   }
 
 private:
   T _stream;
+  OnComment _on_comment;
+  std::string _comment;
   std::optional<token::Token> _lasttok;
   std::optional<token::Token> _peektok;
+  const char *_error{nullptr};
   int64_t _pos{0};
+  int64_t _newline_width{0}; // 0表示还未确定
+  byfxxm::Location _cursor;
+  byfxxm::Location _location;
 };
 
 template <class T> Lexer(T) -> Lexer<T>;
@@ -0,0 +1,268 @@
+﻿#ifndef _BYFXXM_PARALLEL_HPP_
+#define _BYFXXM_PARALLEL_HPP_
+
+#include "../parker.hpp"
+#include "../ring_buffer.hpp"
+#include "syntax.hpp"
+#include <mutex>
+#include <thread>
+
+namespace byfxxm {
+// 解析与执行分离：生产线程提前解析顶层语句放入队列，当前线程执行
+// 语句在生产线程的内存池中分配，用完后也要送回生产线程释放
+// GOTO时递增代数，生产线程跳转后以新代数重新解析，旧代数的语句丢弃
+// 队列满、空或解析到结尾时在Parker上挂起，由对端唤醒
+// 生产线程的统计单独采集，线程结束后并入构造时当前线程正在采集的统计
+template <StreamConcept T, GinterfaceConcept G = Ginterface>
+class ParallelSyntax {
+public:
+  using AbstreeTuple = BasicAbstreeTuple<G>;
+
+  // on_comment在生产线程中回调
+  ParallelSyntax(T &&stream, Address *addr, G *gimpl,
+                 const OnComment &on_comment = {})
+      : _reader(
+            std::move(stream), [this]() { return _return_val; }, on_comment),
+        _addr(addr), _gimpl(gimpl), _stats(stats::current) {
+    _producer = std::jthread([this](std::stop_token st) { _Produce(st); });
+  }
+
+  ~ParallelSyntax() {
+    _Discard(std::move(_current));
+    _producer.request_stop();
+    _producer_parker.Notify();
+    _producer.join();
+    if (_stats)
+      *_stats += _producer_stats;
+  }
+
+  ParallelSyntax(const ParallelSyntax &) = delete;
+  ParallelSyntax &operator=(const ParallelSyntax &) = delete;
+
+  std::optional<AbstreeTuple> Next() {
+    byfxxm_StatsTime(syntax);
+    if (_block) {
+      if (auto seg = (*_block)->Next())
+        return _ToAbstreeTuple(*seg);
+
+      _block = nullptr;
+    }
+
+    _Parsed parsed;
+    do {
+      _Discard(std::move(_current));
+      while (!_queue.Read(parsed))
+        _executor_parker.Wait([this]() { return !_queue.IsEmpty(); }, {});
+
+      _producer_parker.Notify();
+      _current = std::move(parsed.stmt);
+    } while (parsed.epoch != _epoch);
+
+    _snapshot = parsed.snapshot;
+    if (!parsed.error.empty())
+      throw ParseException(std::move(parsed.error));
+
+    if (!_current)
+      return {};
+
+    return std::visit(
+        Overloaded{
+            [this](Segment &seg) { return _ToAbstreeTuple(seg); },
+            [this](UniquePtr<block::Block> &block) {
+              _block = &block;
+              auto seg = block->Next();
+              assert(seg);
+              _block_line = std::get<Snapshot>(*seg).line;
+              return _ToAbstreeTuple(*seg);
+            },
+        },
+        _current.value());
+  }
+
+  bool AtTopLevel() const { return !_block; }
+
+  size_t BlockLine() const { return _block ? _block_line : 0; }
+
+  // 不支持子程序调用
+  size_t CallerLine() const { return 0; }
+
+  // 见Syntax::AtBlockHead
+  bool AtBlockHead(const Snapshot &snapshot) const {
+    return _block && snapshot.line == _block_line;
+  }
+
+  const SnapshotTable &GetSnapshotTable() const { return _snapshot_table; }
+
+  void Restore(const Snapshot &snapshot, const SnapshotTable &table) {
+    _snapshot_table = table;
+    _goto_snapshot(snapshot);
+  }
+
+  void FastForward(size_t line) { _forward_line = line; }
+
+private:
+  struct _Parsed {
+    size_t epoch{0};
+    std::optional<Statement> stmt;
+    Snapshot snapshot;
+    std::string error;
+  };
+
+  void _Produce(std::stop_token st) {
+    byfxxm_StatsScope(&_producer_stats);
+    size_t epoch = 0;
+    bool end = false;
+    // 有待释放的语句、跳转或停止时也要醒来
+    auto wait = [&](auto &&ready) {
+      _Release();
+      _producer_parker.Wait(
+          [&]() {
+            return ready() || !_trash.IsEmpty() || st.stop_requested() ||
+                   _epoch_request != epoch;
+          },
+          {});
+    };
+
+    while (!st.stop_requested()) {
+      _Release();
+      if (auto target = _Target(epoch)) {
+        _reader.Seek(target.value());
+        end = false;
+      }
+
+      if (end) {
+        wait([]() { return false; });
+        continue;
+      }
+
+      _Parsed parsed{epoch, {}, {}, {}};
+      try {
+        parsed.stmt = _reader.Next();
+        end = !parsed.stmt;
+      } catch (const ParseException &ex) {
+        parsed.error =
+            SyntaxException(_reader.GetSnapshot().line, ex.what()).what();
+        end = true;
+      }
+
+      parsed.snapshot = _reader.GetSnapshot();
+      while (!_queue.Write(std::move(parsed))) {
+        if (st.stop_requested() || _epoch_request != epoch)
+          break;
+
+        wait([this]() { return !_queue.IsFull(); });
+      }
+
+      _executor_parker.Notify();
+    }
+
+    // 当前线程已不再读队列，剩余的语句在此释放
+    _Parsed parsed;
+    while (_queue.Read(parsed)) {
+    }
+    _Release();
+  }
+
+  // 有新的跳转请求时返回跳转目标，并更新代数
+  std::optional<Snapshot> _Target(size_t &epoch) {
+    if (_epoch_request == epoch)
+      return {};
+
+    std::lock_guard lock(_mutex);
+    epoch = _epoch_request;
+    return _target;
+  }
+
+  void _Release() {
+    std::optional<Statement> stmt;
+    auto released = false;
+    while (_trash.Read(stmt)) {
+      stmt.reset();
+      released = true;
+    }
+
+    if (released)
+      _executor_parker.Notify();
+  }
+
+  void _Discard(std::optional<Statement> &&stmt) {
+    _block = nullptr;
+    if (!stmt)
+      return;
+
+    while (!_trash.Write(std::move(stmt)))
+      _executor_parker.Wait([this]() { return !_trash.IsFull(); }, {});
+
+    _producer_parker.Notify();
+    stmt.reset();
+  }
+
+  // 到达line行后不再跳过，循环回到之前的行时照常调用
+  G *_Ginterface(const Snapshot &snapshot) {
+    if (snapshot.line < _forward_line)
+      return nullptr;
+
+    _forward_line = 0;
+    return _gimpl;
+  }
+
+  AbstreeTuple _ToAbstreeTuple(Segment &seg) {
+    auto &[root, snapshot] = seg;
+    return {BasicAbstree<G>(root, _return_val, _addr, _Ginterface(snapshot),
+                            {_get_snapshot, _mark_snapshot, _goto_snapshot,
+                             _snapshot_table, _call_subprogram}),
+            snapshot};
+  }
+
+private:
+  // 生产线程独占
+  Reader<T> _reader;
+
+  // 执行线程独占
+  Value _return_val;
+  Address *_addr{nullptr};
+  G *_gimpl{nullptr};
+  std::optional<Statement> _current;
+  UniquePtr<block::Block> *_block{nullptr};
+  size_t _block_line{0};
+  Snapshot _snapshot{1, 0};
+  size_t _forward_line{0};
+  size_t _epoch{0};
+  SnapshotTable _snapshot_table;
+  Stats *_stats{nullptr};
+  Stats _producer_stats; // 只在生产线程中写，join后读
+
+  // 线程间共享
+  RingBuffer<_Parsed, 64> _queue;
+  RingBuffer<std::optional<Statement>, 64> _trash;
+  std::atomic<size_t> _epoch_request{0};
+  std::mutex _mutex;
+  Snapshot _target;
+  Parker _producer_parker; // 生产线程等待队列有空位、待释放的语句、跳转或停止
+  Parker _executor_parker; // 执行线程等待队列非空或回收队列有空位
+
+  const GetSnapshot _get_snapshot = [this]() { return _snapshot; };
+  const MarkSnapshot _mark_snapshot = [this](double k) {
+    _snapshot_table[k] = _snapshot;
+  };
+  // 正在执行的语句不能在此释放，留到下一次Next
+  const GotoSnapshot _goto_snapshot = [this](const Snapshot &snapshot) {
+    byfxxm_StatsCount(gotos);
+    _block = nullptr;
+    std::lock_guard lock(_mutex);
+    _target = snapshot;
+    _epoch_request = ++_epoch;
+    _producer_parker.Notify();
+  };
+  // 子程序要在执行线程中编译，不支持，只能顺序执行
+  const CallSubprogram _call_subprogram =
+      [](const Ginterface::Params &params) {
+        if (subprogram::IsCall(params))
+          throw AbstreeException("subprogram in parallel mode");
+      };
+
+  std::jthread _producer;
+};
+} // namespace byfxxm
+
+#endif
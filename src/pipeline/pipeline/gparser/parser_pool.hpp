@@ -0,0 +1,102 @@
+﻿#ifndef _BYFXXM_PARSER_POOL_HPP_
+#define _BYFXXM_PARSER_POOL_HPP_
+
+#include "gparser.hpp"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace byfxxm {
+// 固定数量的工作线程并发解析多个程序，结果通过future返回
+// 每个程序的Gparser和Address都在工作线程上创建和销毁
+// 每个工作线程从自己的内存池分配，工作线程之间只共享任务队列
+class ParserPool {
+public:
+  struct Result {
+    std::optional<std::string> error;
+    Address::Values values; // 结束时的#变量
+    Stats stats;
+  };
+
+  explicit ParserPool(size_t workers = std::thread::hardware_concurrency()) {
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; ++i) {
+      _workers.emplace_back([this](std::stop_token st) { _Work(st); });
+    }
+  }
+
+  ParserPool(const ParserPool &) = delete;
+  ParserPool &operator=(const ParserPool &) = delete;
+
+  // 析构时先执行完队列中剩余的任务
+  ~ParserPool() {
+    for (auto &worker : _workers)
+      worker.request_stop();
+  }
+
+  // gimpl会在工作线程上调用，多个程序共用时需自行保证线程安全
+  template <StreamConcept T>
+  std::future<Result> Run(T &&stream, Ginterface *gimpl = nullptr) {
+    return _Submit([stream = std::forward<T>(stream), gimpl]() mutable {
+      Gparser parser(std::move(stream));
+      Address addr;
+      Result ret;
+      ret.error = parser.Run(&addr, gimpl);
+      ret.values = addr.Dump();
+      ret.stats = parser.GetStats();
+      return ret;
+    });
+  }
+
+  template <StreamConcept T> std::future<Diagnostics> Validate(T &&stream) {
+    return _Submit([stream = std::forward<T>(stream)]() mutable {
+      return Gparser(std::move(stream)).Validate();
+    });
+  }
+
+  size_t Size() const { return _workers.size(); }
+
+private:
+  template <class F> auto _Submit(F &&func) {
+    std::packaged_task<std::invoke_result_t<F>()> task(std::forward<F>(func));
+    auto ret = task.get_future();
+    {
+      std::lock_guard lock(_mutex);
+      _tasks.emplace_back([task = std::move(task)]() mutable { task(); });
+    }
+
+    _cv.notify_one();
+    return ret;
+  }
+
+  void _Work(std::stop_token st) {
+    std::pmr::unsynchronized_pool_resource pool;
+    MempoolScope scope(&pool);
+    for (;;) {
+      std::packaged_task<void()> task;
+      {
+        std::unique_lock lock(_mutex);
+        if (!_cv.wait(lock, st, [this]() { return !_tasks.empty(); }))
+          return;
+
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+      }
+
+      task();
+    }
+  }
+
+private:
+  std::mutex _mutex;
+  std::condition_variable_any _cv;
+  std::deque<std::packaged_task<void()>> _tasks;
+  std::vector<std::jthread> _workers;
+};
+} // namespace byfxxm
+
+#endif
@@ -5,6 +5,7 @@
 #include "common.hpp"
 #include "exception.hpp"
 #include "ginterface.hpp"
+#include "subprogram.hpp"
 #include <algorithm>
 #include <ranges>
 #include <string>
@@ -21,8 +22,47 @@
   (byfxxm_IsDouble(v) || byfxxm_IsSharpValue(v))
 
 namespace byfxxm {
+// 值类型，语法分析时推导
+enum class Vtype {
+  GENERIC, // 通用，运行时判断
+  NUMERIC, // 纯数值
+  BOOLEAN, // 纯布尔
+};
+
+// 推导结果，error非空表示类型错误
+struct Inferred {
+  Vtype type{Vtype::GENERIC};
+  const char *error{nullptr};
+};
+
 namespace predicate {
+inline Inferred _InferNumeric(std::initializer_list<Vtype> subs,
+                              const char *err) {
+  if (std::ranges::find(subs, Vtype::BOOLEAN) != subs.end())
+    return {Vtype::GENERIC, err};
+
+  auto numeric = std::ranges::all_of(
+      subs, [](Vtype type) { return type == Vtype::NUMERIC; });
+  return {numeric ? Vtype::NUMERIC : Vtype::GENERIC};
+}
+
+// 操作数不能为布尔值，结果类型固定为type
+inline Inferred _InferFixed(Vtype type, std::initializer_list<Vtype> subs,
+                            const char *err) {
+  return {type, _InferNumeric(subs, err).error};
+}
+
+inline Inferred _InferCompare(Vtype lhs, Vtype rhs) {
+  return _InferFixed(Vtype::BOOLEAN, {lhs, rhs}, "compare error");
+}
+
 struct Plus {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferNumeric({lhs, rhs}, "plus error");
+  }
+
+  double operator()(double lhs, double rhs) const { return lhs + rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -39,6 +79,12 @@ struct Plus {
 };
 
 struct Minus {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferNumeric({lhs, rhs}, "minus error");
+  }
+
+  double operator()(double lhs, double rhs) const { return lhs - rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -53,6 +99,12 @@ struct Minus {
 };
 
 struct Multi {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferNumeric({lhs, rhs}, "multiple error");
+  }
+
+  double operator()(double lhs, double rhs) const { return lhs * rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -67,6 +119,12 @@ struct Multi {
 };
 
 struct Div {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferNumeric({lhs, rhs}, "divide error");
+  }
+
+  double operator()(double lhs, double rhs) const { return lhs / rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -81,6 +139,10 @@ struct Div {
 };
 
 struct Assign {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferFixed(Vtype::GENERIC, {lhs, rhs}, "assign error");
+  }
+
   auto operator()(Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -96,6 +158,12 @@ struct Assign {
 };
 
 struct Neg {
+  static Inferred Infer(Vtype value) {
+    return _InferNumeric({value}, "negative error");
+  }
+
+  double operator()(double value) const { return -value; }
+
   auto operator()(const Value &value) const {
     return std::visit(
         [](auto &&v) -> Value {
@@ -109,6 +177,12 @@ struct Neg {
 };
 
 struct Pos {
+  static Inferred Infer(Vtype value) {
+    return _InferNumeric({value}, "positive error");
+  }
+
+  double operator()(double value) const { return +value; }
+
   auto operator()(const Value &value) const {
     return std::visit(
         [](auto &&v) -> Value {
@@ -122,6 +196,17 @@ struct Pos {
 };
 
 struct Sharp {
+  static Inferred Infer(Vtype value) {
+    return _InferFixed(Vtype::NUMERIC, {value}, "sharp error");
+  }
+
+  double operator()(double value, Address *addr) const {
+    if (!addr)
+      throw AbstreeException();
+
+    return (*addr)[value];
+  }
+
   auto operator()(const Value &value, Address *addr) const {
     if (!addr)
       throw AbstreeException();
@@ -138,6 +223,12 @@ struct Sharp {
 };
 
 struct GT {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferCompare(lhs, rhs);
+  }
+
+  bool operator()(double lhs, double rhs) const { return lhs > rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -152,6 +243,12 @@ struct GT {
 };
 
 struct GE {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferCompare(lhs, rhs);
+  }
+
+  bool operator()(double lhs, double rhs) const { return lhs >= rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -166,6 +263,12 @@ struct GE {
 };
 
 struct LT {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferCompare(lhs, rhs);
+  }
+
+  bool operator()(double lhs, double rhs) const { return lhs < rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -180,6 +283,12 @@ struct LT {
 };
 
 struct LE {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferCompare(lhs, rhs);
+  }
+
+  bool operator()(double lhs, double rhs) const { return lhs <= rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -194,6 +303,12 @@ struct LE {
 };
 
 struct EQ {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferCompare(lhs, rhs);
+  }
+
+  bool operator()(double lhs, double rhs) const { return lhs == rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -208,6 +323,12 @@ struct EQ {
 };
 
 struct NE {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferCompare(lhs, rhs);
+  }
+
+  bool operator()(double lhs, double rhs) const { return lhs != rhs; }
+
   auto operator()(const Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -222,6 +343,10 @@ struct NE {
 };
 
 template <token::Kind Tok> struct Gcode {
+  static Inferred Infer(Vtype value) {
+    return _InferFixed(Vtype::GENERIC, {value}, "gcode error");
+  }
+
   auto operator()(const Value &value) const {
     return std::visit(
         [](auto &&v) -> Value {
@@ -235,6 +360,10 @@ template <token::Kind Tok> struct Gcode {
 };
 
 struct Comma {
+  static Inferred Infer(Vtype lhs, Vtype rhs) {
+    return _InferFixed(Vtype::GENERIC, {lhs, rhs}, "comma error");
+  }
+
   auto operator()(Value &lhs, const Value &rhs) const {
     return std::visit(
         [](auto &&l, auto &&r) -> Value {
@@ -252,6 +381,10 @@ struct Comma {
 };
 
 struct Max {
+  static Inferred Infer(Vtype value) {
+    return _InferFixed(Vtype::NUMERIC, {value}, "max error");
+  }
+
   auto operator()(Value &value) const {
     return std::visit(
         [](auto &&v) -> Value {
@@ -267,6 +400,10 @@ struct Max {
 };
 
 struct Min {
+  static Inferred Infer(Vtype value) {
+    return _InferFixed(Vtype::NUMERIC, {value}, "min error");
+  }
+
   auto operator()(Value &value) const {
     return std::visit(
         [](auto &&v) -> Value {
@@ -282,6 +419,15 @@ struct Min {
 };
 
 struct Not {
+  static Inferred Infer(Vtype value) {
+    if (value == Vtype::NUMERIC)
+      return {Vtype::BOOLEAN, R"("NOT" error)"};
+
+    return {Vtype::BOOLEAN};
+  }
+
+  bool operator()(bool value) const { return !value; }
+
   auto operator()(const Value &value) const {
     return std::visit(
         [](auto &&v) -> Value {
@@ -295,6 +441,10 @@ struct Not {
 };
 
 struct Goto {
+  static Inferred Infer(Vtype value) {
+    return _InferFixed(Vtype::GENERIC, {value}, "goto error");
+  }
+
   auto operator()(const Value &value, const GotoSnapshot &goto_snapshot,
                   const SnapshotTable &table) const {
     return std::visit(
@@ -336,38 +486,100 @@ inline const std::pmr::unordered_map<Gtag, Gfunc, _GtagHash, _GtagEqual>
                           {{token::Kind::G, 2}, &Ginterface::G2},
                           {{token::Kind::G, 3}, &Ginterface::G3},
                           {{token::Kind::G, 4}, &Ginterface::G4},
+                          {{token::Kind::G, 73}, &Ginterface::Cycle},
+                          {{token::Kind::G, 74}, &Ginterface::Cycle},
+                          {{token::Kind::G, 76}, &Ginterface::Cycle},
+                          {{token::Kind::G, 80}, &Ginterface::Cycle},
+                          {{token::Kind::G, 81}, &Ginterface::Cycle},
+                          {{token::Kind::G, 82}, &Ginterface::Cycle},
+                          {{token::Kind::G, 83}, &Ginterface::Cycle},
+                          {{token::Kind::G, 84}, &Ginterface::Cycle},
+                          {{token::Kind::G, 85}, &Ginterface::Cycle},
+                          {{token::Kind::G, 86}, &Ginterface::Cycle},
+                          {{token::Kind::G, 87}, &Ginterface::Cycle},
+                          {{token::Kind::G, 88}, &Ginterface::Cycle},
+                          {{token::Kind::G, 89}, &Ginterface::Cycle},
                           {{token::Kind::N}, &Ginterface::N}};
 
-struct Gcmd {
-  auto operator()(const std::pmr::vector<Value> &tags, Address *addr,
-                  Ginterface *gimpl, const MarkSnapshot &mark_snapshot) const
-      -> Value {
-    if (!gimpl)
-      return {};
+// G为Ginterface时经虚函数调用，为具体类型时直接调用，可以内联
+template <GinterfaceConcept G>
+void Invoke(Gfunc func, G *gimpl, const Ginterface::Utils &utils) {
+  if constexpr (std::is_same_v<G, Ginterface>)
+    std::invoke(func, gimpl, utils);
+  else if (func == &Ginterface::G0)
+    gimpl->G0(utils);
+  else if (func == &Ginterface::G1)
+    gimpl->G1(utils);
+  else if (func == &Ginterface::G2)
+    gimpl->G2(utils);
+  else if (func == &Ginterface::G3)
+    gimpl->G3(utils);
+  else if (func == &Ginterface::G4)
+    gimpl->G4(utils);
+  else if (func == &Ginterface::N)
+    gimpl->N(utils);
+  else if (func == &Ginterface::Cycle)
+    gimpl->Cycle(utils);
+  else
+    gimpl->None(utils);
+}
 
+struct Gcmd {
+  template <GinterfaceConcept G>
+  auto operator()(const std::pmr::vector<Value> &tags, Address *addr, G *gimpl,
+                  const MarkSnapshot &mark_snapshot,
+                  const CallSubprogram &call_subprogram) const -> Value {
     if (tags.empty())
       throw AbstreeException();
 
-    Ginterface::Params params{&mempool};
-    auto cmds = tags | std::views::filter([&](const Value &elem) {
-                  auto tag = std::get<Gtag>(elem);
-                  if (gtag_to_ginterface.contains(tag) ||
-                      gtag_to_ginterface.contains(Gtag{tag.code})) {
-                    return true;
-                  }
+    auto is_cmd = [](const Value &elem) {
+      auto tag = std::get<Gtag>(elem);
+      return gtag_to_ginterface.contains(tag) ||
+             gtag_to_ginterface.contains(Gtag{tag.code});
+    };
+
+    // 先收集全部参数，再依次调用指令
+    Ginterface::Params params;
+    std::ranges::for_each(
+        tags | std::views::filter(std::not_fn(is_cmd)),
+        [&](auto &&elem) { params.Set(std::get<Gtag>(elem)); });
 
-                  params.push_back(tag);
-                  return false;
-                });
+    // 子程序调用与返回在快进时也要执行
+    auto call = subprogram::IsCall(params) || subprogram::IsReturn(params);
+    if (call)
+      call_subprogram(params);
 
-    std::ranges::for_each(cmds, [&](auto &&elem) {
+    if (!gimpl)
+      return {};
+
+    // 只有M、S、F等字的段不沿用模态指令
+    constexpr auto modal_words =
+        Gparams::Bit(token::Kind::G) | Gparams::Bit(token::Kind::X) |
+        Gparams::Bit(token::Kind::Y) | Gparams::Bit(token::Kind::Z) |
+        Gparams::Bit(token::Kind::A) | Gparams::Bit(token::Kind::B) |
+        Gparams::Bit(token::Kind::C) | Gparams::Bit(token::Kind::I) |
+        Gparams::Bit(token::Kind::J) | Gparams::Bit(token::Kind::K) |
+        Gparams::Bit(token::Kind::R) | Gparams::Bit(token::Kind::Q);
+    auto modal = !call && (params.Mask() & modal_words);
+    std::ranges::for_each(tags | std::views::filter(is_cmd), [&](auto &&elem) {
       auto tag = std::get<Gtag>(elem);
       auto func = gtag_to_ginterface.at(
           gtag_to_ginterface.contains(Gtag{tag.code}) ? Gtag{tag.code} : tag);
-      std::invoke(func, gimpl,
-                  Ginterface::Utils{tag.value, params, addr, mark_snapshot});
+      modal = modal && tag.code != token::Kind::G;
+      byfxxm_StatsTime(ginterface);
+      Invoke(func, gimpl,
+             Ginterface::Utils{tag.value, params, addr, mark_snapshot});
     });
 
+    // 没有G指令而有坐标、循环参数或其它G字的段沿用上一个模态指令，
+    // 如固定循环的孔位
+    if (modal) {
+      byfxxm_StatsTime(ginterface);
+      Invoke(&Ginterface::None, gimpl,
+             Ginterface::Utils{Gtag::default_value, params, addr,
+                               mark_snapshot});
+    }
+
     return {};
   }
 };
@@ -383,6 +595,8 @@ using Unary = std::variant<
     predicate::Gcode<token::Kind::J>, predicate::Gcode<token::Kind::K>,
     predicate::Gcode<token::Kind::N>, predicate::Gcode<token::Kind::F>,
     predicate::Gcode<token::Kind::S>, predicate::Gcode<token::Kind::O>,
+    predicate::Gcode<token::Kind::P>, predicate::Gcode<token::Kind::L>,
+    predicate::Gcode<token::Kind::R>, predicate::Gcode<token::Kind::Q>,
     predicate::Max, predicate::Min, predicate::Not>;
 
 // 二元操作符
@@ -50,41 +50,97 @@ inline const std::pmr::unordered_map<token::Kind, TokenTraits> token_traits = {
     {token::Kind::F, {5, Unary{predicate::Gcode<token::Kind::F>{}}}},
     {token::Kind::S, {5, Unary{predicate::Gcode<token::Kind::S>{}}}},
     {token::Kind::O, {5, Unary{predicate::Gcode<token::Kind::O>{}}}},
+    {token::Kind::P, {5, Unary{predicate::Gcode<token::Kind::P>{}}}},
+    {token::Kind::L, {5, Unary{predicate::Gcode<token::Kind::L>{}}}},
+    {token::Kind::R, {5, Unary{predicate::Gcode<token::Kind::R>{}}}},
+    {token::Kind::Q, {5, Unary{predicate::Gcode<token::Kind::Q>{}}}},
     {token::Kind::CON, {}},
     {token::Kind::GOTO, {0, Goto{predicate::Goto{}}}},
 };
 
+// 推导节点的值类型，能静态确定的类型错误记录在err中
+inline void InferType(Abstree::Node &node, ParseError &err) {
+  auto sub = [&](size_t index) { return node.subs[index]->type; };
+  auto inferred = std::visit(
+      Overloaded{
+          [](const Value &value) -> Inferred {
+            if (std::holds_alternative<double>(value))
+              return {Vtype::NUMERIC};
+            if (std::holds_alternative<bool>(value))
+              return {Vtype::BOOLEAN};
+            return {Vtype::GENERIC};
+          },
+          [&](const Unary &unary) {
+            return std::visit([&](auto &&func) { return func.Infer(sub(0)); },
+                              unary);
+          },
+          [&](const Binary &binary) {
+            return std::visit(
+                [&](auto &&func) { return func.Infer(sub(0), sub(1)); },
+                binary);
+          },
+          [&](const Sharp &sharp) {
+            return std::visit([&](auto &&func) { return func.Infer(sub(0)); },
+                              sharp);
+          },
+          [](const Gcmd &) { return Inferred{Vtype::GENERIC}; },
+          [&](const Goto &goto_) {
+            return std::visit([&](auto &&func) { return func.Infer(sub(0)); },
+                              goto_);
+          },
+      },
+      node.pred);
+
+  node.type = inferred.type;
+  if (inferred.error)
+    err = {errc::TYPE, inferred.error};
+}
+
 using SyntaxNode = std::variant<token::Token, Abstree::NodePtr>;
 using SyntaxNodeList = std::pmr::vector<SyntaxNode>;
 
+// 出错时返回空，错误记录在err中
 class Expression {
 public:
-  Abstree::NodePtr operator()(SyntaxNodeList &list) const {
-    return _Expression(list);
+  Abstree::NodePtr operator()(SyntaxNodeList &list, ParseError &err) const {
+    return _Expression(list, err);
   }
 
 private:
-  Abstree::NodePtr _Expression(std::ranges::range auto &&rng) const {
+  Abstree::NodePtr _Expression(std::ranges::range auto &&rng,
+                               ParseError &err) const {
     if (rng.empty())
       return {};
 
-    SyntaxNodeList list = _ProcessBracket(rng);
-    auto minpri = _FindMinPriority(list);
+    SyntaxNodeList list = _ProcessBracket(rng, err);
+    if (err)
+      return {};
 
+    auto minpri = _FindMinPriority(list);
     auto node = _CurNode(*minpri);
-    if (auto first = _Expression(std::ranges::subrange(list.begin(), minpri)))
+    if (auto first =
+            _Expression(std::ranges::subrange(list.begin(), minpri), err))
       node->subs.push_back(std::move(first));
     if (auto second =
-            _Expression(std::ranges::subrange(minpri + 1, list.end())))
+            _Expression(std::ranges::subrange(minpri + 1, list.end()), err))
       node->subs.push_back(std::move(second));
+    if (err)
+      return {};
+
+    _CheckError(node, err);
+    if (!err)
+      InferType(*node, err);
+    if (err)
+      return {};
 
-    _CheckError(node);
     return node;
   }
 
-  SyntaxNodeList _ProcessBracket(std::ranges::range auto &&rng) const {
-    SyntaxNodeList main{&mempool};
-    SyntaxNodeList sub{&mempool};
+  // 括号内的子表达式先归约为节点，不认识的单词在此报错
+  SyntaxNodeList _ProcessBracket(std::ranges::range auto &&rng,
+                                 ParseError &err) const {
+    SyntaxNodeList main{&Mempool()};
+    SyntaxNodeList sub{&Mempool()};
     int level = 0;
     for (auto &node : rng) {
       if (std::holds_alternative<Abstree::NodePtr>(node)) {
@@ -100,22 +156,36 @@ private:
       } else if (tok.kind == token::Kind::RB) {
         --level;
         if (level == 0) {
-          main.push_back(_Expression(sub));
+          auto inner = _Expression(sub, err);
+          if (!inner) {
+            if (!err)
+              err = SyntaxError("empty bracket");
+            return {};
+          }
+
+          main.push_back(std::move(inner));
           sub.clear();
           continue;
         }
       }
 
-      if (level > 0)
+      if (level > 0) {
         sub.push_back(std::move(tok));
-      else if (level == 0)
+      } else if (level < 0) {
+        err = SyntaxError("unbalanced bracket");
+        return {};
+      } else if (!token_traits.contains(tok.kind)) {
+        err = SyntaxError("unexpected word");
+        return {};
+      } else {
         main.push_back(std::move(tok));
-      else
-        throw SyntaxException();
+      }
     }
 
-    if (level != 0)
-      throw SyntaxException();
+    if (level != 0) {
+      err = SyntaxError("unbalanced bracket");
+      return {};
+    }
 
     return main;
   }
@@ -144,10 +214,11 @@ private:
   }
 
   Abstree::NodePtr _CurNode(SyntaxNode &node) const {
-    auto ret = MakeUnique<Abstree::Node>(mempool);
+    auto ret = MakeUnique<Abstree::Node>(Mempool());
     if (auto abs = std::get_if<Abstree::NodePtr>(&node)) {
       ret = std::move(*abs);
     } else {
+      byfxxm_StatsCount(nodes);
       auto &tok = std::get<token::Token>(node);
       if (!tok.value)
         ret->pred = token_traits.at(tok.kind).pred;
@@ -159,66 +230,66 @@ private:
     return ret;
   }
 
-  void _CheckError(const Abstree::NodePtr &node) const {
+  // 子节点个数与谓词不符时记录语法错误
+  void _CheckError(const Abstree::NodePtr &node, ParseError &err) const {
     assert(node);
-    std::visit(Overloaded{
-                   [&](const Value &value) {
-                     if (std::holds_alternative<std::monostate>(value))
-                       return;
-
-                     if (!node->subs.empty())
-                       throw SyntaxException();
-                   },
-                   [&](const Unary &) {
-                     if (node->subs.size() != 1)
-                       throw SyntaxException();
-                   },
-                   [&](const Binary &) {
-                     if (node->subs.size() != 2)
-                       throw SyntaxException();
-                   },
-                   [&](const Sharp &) {
-                     if (node->subs.size() != 1)
-                       throw SyntaxException();
-                   },
-                   [&](const Gcmd &) {
-                     if (node->subs.size() == 0)
-                       throw SyntaxException();
-                   },
-                   [&](const Goto &) {
-                     if (node->subs.size() != 1)
-                       throw SyntaxException();
-                   },
-               },
-               node->pred);
+    auto size = node->subs.size();
+    auto ok = std::visit(
+        Overloaded{
+            [&](const Value &value) {
+              return std::holds_alternative<std::monostate>(value) ||
+                     size == 0;
+            },
+            [&](const Unary &) { return size == 1; },
+            [&](const Binary &) { return size == 2; },
+            [&](const Sharp &) { return size == 1; },
+            [&](const Gcmd &) { return size != 0; },
+            [&](const Goto &) { return size == 1; },
+        },
+        node->pred);
+    if (!ok)
+      err = SyntaxError("missing operand");
   }
 };
 
+// list由G代码单词和其后的表达式交替组成，出错时返回空，错误记录在err中
 class Gtree {
 public:
-  Abstree::NodePtr operator()(SyntaxNodeList &list) const {
-    if (list.empty() || (list.size() & 0x1) != 0)
-      throw SyntaxException();
+  Abstree::NodePtr operator()(SyntaxNodeList &list, ParseError &err) const {
+    if (list.empty() || (list.size() & 0x1) != 0) {
+      err = SyntaxError("missing value");
+      return {};
+    }
 
-    auto root = MakeUnique<Abstree::Node>(mempool);
+    auto root = MakeUnique<Abstree::Node>(Mempool());
     root->pred = Gcmd{};
-    for (auto iter = list.begin(); iter != list.end();) {
-      auto node = MakeUnique<Abstree::Node>(mempool);
-      node->pred = _TokToPred(std::get<token::Token>(*iter++));
-      node->subs.push_back(std::move(std::get<Abstree::NodePtr>(*iter++)));
+    byfxxm_StatsCount(nodes);
+    for (auto iter = list.begin(); iter != list.end(); iter += 2) {
+      auto tok = std::get_if<token::Token>(&*iter);
+      auto sub = std::get_if<Abstree::NodePtr>(&*(iter + 1));
+      if (!tok || !sub) {
+        err = SyntaxError("missing value");
+        return {};
+      }
+
+      if (!token_traits.contains(tok->kind)) {
+        err = SyntaxError("unexpected word");
+        return {};
+      }
+
+      auto node = MakeUnique<Abstree::Node>(Mempool());
+      node->pred = token_traits.at(tok->kind).pred;
+      byfxxm_StatsCount(nodes);
+      node->subs.push_back(std::move(*sub));
+      InferType(*node, err);
+      if (err)
+        return {};
+
       root->subs.push_back(std::move(node));
     }
 
     return root;
   }
-
-private:
-  Predicate _TokToPred(const token::Token &tok) const {
-    if (!token_traits.contains(tok.kind))
-      throw SyntaxException();
-
-    return token_traits.at(tok.kind).pred;
-  }
 };
 
 inline constexpr Expression expr;
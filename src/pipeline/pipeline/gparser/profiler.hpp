@@ -0,0 +1,96 @@
+﻿#ifndef _BYFXXM_PROFILER_HPP_
+#define _BYFXXM_PROFILER_HPP_
+
+#include "stats.hpp"
+#include <algorithm>
+#include <format>
+#include <map>
+#include <ostream>
+#include <vector>
+
+namespace byfxxm {
+// 按源码行统计执行次数和耗时(时钟周期)
+// 次数每条都记，耗时每interval条采样一次，按interval放大作为估算值
+class Profiler {
+public:
+  struct Entry {
+    size_t line{};
+    size_t count{};
+    uint64_t ticks{};
+  };
+
+  Profiler(size_t interval = 1) : _interval(std::max<size_t>(interval, 1)) {}
+
+  // 本条语句是否采样计时
+  bool Due() {
+    if (++_tick < _interval)
+      return false;
+
+    _tick = 0;
+    return true;
+  }
+
+  void Count(size_t line) { _Entry(line).count++; }
+
+  // block为所在代码块的起始行，顶层语句为0
+  void Sample(size_t line, size_t block, uint64_t ticks) {
+    ticks *= _interval;
+    _Entry(line).ticks += ticks;
+    _stacks[{block, line}] += ticks;
+  }
+
+  // 按耗时降序
+  std::vector<Entry> Entries() const {
+    std::vector<Entry> ret;
+    std::ranges::copy_if(_lines, std::back_inserter(ret),
+                         [](const Entry &e) { return e.count > 0; });
+    std::ranges::sort(ret, [](const Entry &l, const Entry &r) {
+      return l.ticks != r.ticks ? l.ticks > r.ticks : l.count > r.count;
+    });
+    return ret;
+  }
+
+  void Report(std::ostream &os) const {
+    auto entries = Entries();
+    uint64_t total = 0;
+    for (auto &e : entries)
+      total += e.ticks;
+
+    os << std::format("{:>8} {:>12} {:>16} {:>7}\n", "line", "count", "ticks",
+                      "%");
+    for (auto &e : entries) {
+      os << std::format("{:>8} {:>12} {:>16} {:>7.2f}\n", e.line, e.count,
+                        e.ticks, total ? 100.0 * e.ticks / total : 0.0);
+    }
+  }
+
+  // 折叠栈格式，可直接交给flamegraph.pl
+  void Folded(std::ostream &os) const {
+    for (auto &[key, ticks] : _stacks) {
+      auto &[block, line] = key;
+      if (block == 0 || block == line)
+        os << std::format("main;L{} {}\n", line, ticks);
+      else
+        os << std::format("main;L{};L{} {}\n", block, line, ticks);
+    }
+  }
+
+private:
+  Entry &_Entry(size_t line) {
+    if (line >= _lines.size())
+      _lines.resize(line + 1);
+
+    auto &e = _lines[line];
+    e.line = line;
+    return e;
+  }
+
+private:
+  size_t _interval{1};
+  size_t _tick{0};
+  std::vector<Entry> _lines;
+  std::map<std::pair<size_t, size_t>, uint64_t> _stacks;
+};
+} // namespace byfxxm
+
+#endif
@@ -0,0 +1,443 @@
+﻿#ifndef _BYFXXM_STATIC_STREAM_HPP_
+#define _BYFXXM_STATIC_STREAM_HPP_
+
+#include "lexer.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace byfxxm {
+// 可作为模板参数的字符串字面量
+template <size_t N> struct FixedString {
+  consteval FixedString(const char (&str)[N]) { std::copy_n(str, N, data); }
+
+  constexpr std::string_view View() const { return {data, N - 1}; }
+
+  char data[N]{};
+};
+
+namespace static_nc {
+enum class nc_error {
+  none,
+  unknown_character,
+  unknown_word,
+  malformed_number,
+  inexact_number,
+  unterminated_comment,
+  unbalanced_bracket,
+  missing_then,
+  missing_do,
+  unmatched_block,
+  unclosed_block,
+  nesting_too_deep,
+};
+
+struct Token {
+  token::Kind kind{token::Kind::KEOF};
+  double value{nan};
+  bool valued{false}; // CON和地址字母带值
+  Location location;
+};
+
+// 注释在源码中的位置，token为其后第一个单词的序号
+struct Comment {
+  size_t begin{0};
+  size_t length{0};
+  size_t line{0};
+  size_t token{0};
+};
+
+template <size_t Tokens, size_t Comments> struct Program {
+  std::array<Token, Tokens> tokens{};
+  size_t count{0};
+  std::array<Comment, Comments> comments{};
+  size_t comment_count{0};
+  nc_error error{nc_error::none};
+  size_t line{0}; // 出错的行
+};
+
+constexpr const token::Spelling *_Find(std::span<const token::Spelling> list,
+                                       std::string_view word) {
+  auto iter = std::ranges::find(list, word, &token::Spelling::word);
+  return iter == list.end() ? nullptr : &*iter;
+}
+
+constexpr bool _StartsAny(std::span<const token::Spelling> list, char ch) {
+  return std::ranges::any_of(
+      list, [&](auto &&spelling) { return spelling.word[0] == ch; });
+}
+
+constexpr bool _IsAlpha(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+// 有效数字凑成的整数不超过2^53、小数不超过22位时，被除数和10的幂都是精确的
+// double，一次除法的舍入与运行时的std::from_chars一致，超出时报错
+constexpr nc_error _ToNumber(std::string_view word, double &value) {
+  if (!token::IsNumber(word))
+    return nc_error::malformed_number;
+
+  constexpr uint64_t max_exact = uint64_t{1} << 53;
+  constexpr int max_decimals = 22;
+  uint64_t mantissa = 0;
+  int decimals = 0;
+  int zeros = 0; // 小数部分的0等到后面出现非0数字时才计入，末尾的0不影响精度
+  bool fraction = false;
+  for (auto ch : word) {
+    if (ch == '.') {
+      fraction = true;
+      continue;
+    }
+
+    if (fraction && ch == '0') {
+      ++zeros;
+      continue;
+    }
+
+    for (; zeros > 0; --zeros) {
+      mantissa *= 10;
+      ++decimals;
+      if (mantissa > max_exact)
+        return nc_error::inexact_number;
+    }
+
+    mantissa = mantissa * 10 + (ch - '0');
+    decimals += fraction ? 1 : 0;
+    if (mantissa > max_exact)
+      return nc_error::inexact_number;
+  }
+
+  if (decimals > max_decimals)
+    return nc_error::inexact_number;
+
+  double scale = 1;
+  for (int i = 0; i < decimals; ++i)
+    scale *= 10;
+
+  value = static_cast<double>(mantissa) / scale;
+  return nc_error::none;
+}
+
+// 编译时的草稿：源码中每个字符最多产生一个单词，另加一个KEOF
+template <size_t N> using _Draft = Program<N + 1, N / 2 + 1>;
+
+// 按Lexer的规则切分单词，并检查括号、IF/ENDIF、WHILE/END的配对
+template <size_t N> consteval _Draft<N> Compile(std::string_view source) {
+  _Draft<N> prog;
+  Location cursor;
+  size_t pos = 0;
+  auto fail = [&](nc_error error, size_t line) {
+    prog.error = error;
+    prog.line = line;
+    return prog;
+  };
+  auto push = [&](token::Kind kind, Location loc, bool valued = false,
+                  double value = nan) {
+    prog.tokens[prog.count++] = Token{kind, value, valued, loc};
+  };
+  auto get = [&]() {
+    auto ch = source[pos++];
+    if (ch == '\n') {
+      ++cursor.line;
+      cursor.column = 1;
+    } else {
+      ++cursor.column;
+    }
+
+    return ch;
+  };
+
+  for (;;) {
+    while (pos < source.size() && token::IsSpace(source[pos]))
+      get();
+
+    auto loc = cursor;
+    if (pos == source.size()) {
+      push(token::Kind::KEOF, loc, true);
+      break;
+    }
+
+    if (source[pos] == comment_begin) {
+      auto end = source.find_first_of(")\n", pos);
+      if (end == source.npos || source[end] != comment_end)
+        return fail(nc_error::unterminated_comment, loc.line);
+
+      prog.comments[prog.comment_count++] =
+          Comment{pos + 1, end - pos - 1, loc.line, prog.count};
+      while (pos <= end)
+        get();
+      continue;
+    }
+
+    if (source[pos] == percent) {
+      while (pos < source.size() && !token::IsNewline(source[pos]))
+        get();
+      continue;
+    }
+
+    auto begin = pos;
+    auto ch = get();
+    if (token::IsSharp(ch)) {
+      push(token::Kind::SHARP, loc);
+    } else if (token::IsDigit(ch)) {
+      while (pos < source.size() && token::IsNumeric(source[pos]))
+        get();
+
+      double value = 0;
+      if (auto error = _ToNumber(source.substr(begin, pos - begin), value);
+          error != nc_error::none)
+        return fail(error, loc.line);
+
+      push(token::Kind::CON, loc, true, value);
+    } else if (_StartsAny(token::keyword_spellings, ch) ||
+               _StartsAny(token::gcode_spellings, ch)) {
+      if (_StartsAny(token::keyword_spellings, ch)) {
+        while (pos < source.size() && _IsAlpha(source[pos]))
+          get();
+      }
+
+      auto word = source.substr(begin, pos - begin);
+      if (auto key = _Find(token::keyword_spellings, word))
+        push(key->kind, loc);
+      else if (auto gcode = _Find(token::gcode_spellings, word))
+        push(gcode->kind, loc, true);
+      else
+        return fail(nc_error::unknown_word, loc.line);
+    } else if (auto sym = _Find(token::symbol_spellings, {&ch, 1})) {
+      auto last = prog.count ? std::optional(prog.tokens[prog.count - 1].kind)
+                             : std::nullopt;
+      push(token::ResolveSign(sym->kind, last), loc);
+    } else if (token::IsNewline(ch)) {
+      push(token::Kind::NEWLINE, loc);
+    } else {
+      return fail(nc_error::unknown_character, loc.line);
+    }
+  }
+
+  // 代码块按行检查：IF行以THEN结尾，WHILE行以DO结尾
+  constexpr size_t max_depth = 64;
+  std::array<std::pair<token::Kind, size_t>, max_depth> blocks{};
+  size_t depth = 0;
+  int brackets = 0;
+  token::Kind opener = token::Kind::NEWLINE;
+  token::Kind last = token::Kind::NEWLINE;
+  for (size_t i = 0; i < prog.count; ++i) {
+    auto &tok = prog.tokens[i];
+    auto line = tok.location.line;
+    switch (tok.kind) {
+    case token::Kind::LB:
+      ++brackets;
+      break;
+    case token::Kind::RB:
+      if (--brackets < 0)
+        return fail(nc_error::unbalanced_bracket, line);
+      break;
+    case token::Kind::IF:
+    case token::Kind::ELSEIF:
+    case token::Kind::WHILE:
+      opener = tok.kind;
+      break;
+    case token::Kind::NEWLINE:
+    case token::Kind::KEOF:
+      if (brackets != 0)
+        return fail(nc_error::unbalanced_bracket, line);
+
+      if (opener == token::Kind::WHILE && last != token::Kind::DO)
+        return fail(nc_error::missing_do, line);
+
+      if (opener != token::Kind::NEWLINE && opener != token::Kind::WHILE &&
+          last != token::Kind::THEN)
+        return fail(nc_error::missing_then, line);
+
+      if (opener == token::Kind::IF || opener == token::Kind::WHILE) {
+        if (depth == max_depth)
+          return fail(nc_error::nesting_too_deep, line);
+
+        blocks[depth++] = {opener, line};
+      }
+
+      opener = token::Kind::NEWLINE;
+      break;
+    default:
+      break;
+    }
+
+    switch (tok.kind) {
+    case token::Kind::ELSEIF:
+    case token::Kind::ELSE:
+    case token::Kind::ENDIF:
+      if (depth == 0 || blocks[depth - 1].first != token::Kind::IF)
+        return fail(nc_error::unmatched_block, line);
+
+      if (tok.kind == token::Kind::ENDIF)
+        --depth;
+      break;
+    case token::Kind::END:
+      if (depth == 0 || blocks[depth - 1].first != token::Kind::WHILE)
+        return fail(nc_error::unmatched_block, line);
+
+      --depth;
+      break;
+    default:
+      break;
+    }
+
+    last = tok.kind;
+  }
+
+  if (depth != 0)
+    return fail(nc_error::unclosed_block, blocks[depth - 1].second);
+
+  return prog;
+}
+
+// 只保留实际产生的单词和注释
+template <FixedString S> consteval auto _Compile() {
+  constexpr auto draft = Compile<S.View().size()>(S.View());
+  Program<draft.count, draft.comment_count> prog;
+  std::copy_n(draft.tokens.begin(), draft.count, prog.tokens.begin());
+  prog.count = draft.count;
+  std::copy_n(draft.comments.begin(), draft.comment_count,
+              prog.comments.begin());
+  prog.comment_count = draft.comment_count;
+  prog.error = draft.error;
+  prog.line = draft.line;
+  return prog;
+}
+
+template <FixedString S> inline constexpr auto compiled = _Compile<S>();
+
+// 未定义，实例化时编译器在错误信息中给出出错的行号和原因
+template <size_t Line, nc_error Error> struct NcError;
+
+template <size_t Line, nc_error Error> consteval bool Check() {
+  if constexpr (Error != nc_error::none)
+    return sizeof(NcError<Line, Error>) == 0;
+  else
+    return true;
+}
+} // namespace static_nc
+
+// 编译期完成词法分析和代码块配对检查的NC程序，运行时直接读取单词，不再扫描字符
+// 注释和%行在编译期跳过，注释内容仍可通过OnComment取得
+// 有错误时编译失败，错误信息中的static_nc::NcError<行号, 原因>指出出错的行
+template <FixedString S> class StaticStream {
+public:
+  static constexpr auto &program = static_nc::compiled<S>;
+  static_assert(static_nc::Check<program.line, program.error>());
+
+  // 字符接口，满足StreamConcept
+  int get() {
+    auto ret = peek();
+    if (!_eof)
+      ++_pos;
+
+    return ret;
+  }
+
+  int peek() {
+    _eof = _pos >= S.View().size();
+    return _eof ? std::char_traits<char>::eof() : S.View()[_pos];
+  }
+
+  bool eof() const { return _eof; }
+  void clear() { _eof = false; }
+
+  StaticStream &seekg(int64_t pos) {
+    _pos = static_cast<size_t>(pos);
+    return *this;
+  }
+
+private:
+  size_t _pos{0};
+  bool _eof{false};
+};
+
+// 位置为单词的序号，Seekg和BackToBeginningOfLine按单词移动
+template <FixedString S> class Lexer<StaticStream<S>> {
+public:
+  Lexer(StaticStream<S> &&, const OnComment &on_comment = {})
+      : _on_comment(on_comment) {}
+
+  token::Token Get() {
+    byfxxm_StatsCount(tokens);
+    auto tok = Peek();
+    if (_index + 1 < _program.count)
+      ++_index;
+
+    return tok;
+  }
+
+  token::Token Peek() {
+    // 与逐字符扫描一样，读到注释之后的单词时回调
+    while (_notified < _program.comment_count &&
+           _program.comments[_notified].token <= _index) {
+      auto &comment = _program.comments[_notified++];
+      if (_on_comment)
+        _on_comment(S.View().substr(comment.begin, comment.length),
+                    comment.line);
+    }
+
+    auto &tok = _program.tokens[_index];
+    _location = tok.location;
+    if (!tok.valued)
+      return {tok.kind, {}};
+
+    return {tok.kind, tok.value};
+  }
+
+  // 词法错误已在编译期检查，运行时不会出错
+  token::Token TryGet() { return Get(); }
+  token::Token TryPeek() { return Peek(); }
+  const char *Error() const { return nullptr; }
+
+  auto Tellg() const { return static_cast<int64_t>(_index); }
+
+  auto Location() const { return _location; }
+
+  void SkipLine() {
+    while (_index + 1 < _program.count &&
+           _program.tokens[_index].kind != token::Kind::NEWLINE)
+      ++_index;
+
+    if (_program.tokens[_index].kind == token::Kind::NEWLINE)
+      ++_index;
+  }
+
+  void Seekg(int64_t pos) {
+    _index = static_cast<size_t>(pos);
+    _Rewind();
+  }
+
+  auto BackToBeginningOfLine() {
+    while (_index > 0 &&
+           _program.tokens[_index - 1].kind != token::Kind::NEWLINE)
+      --_index;
+
+    _Rewind();
+    return Tellg();
+  }
+
+private:
+  // 跳转后，位置之后的注释重新回调
+  void _Rewind() {
+    _notified = 0;
+    while (_notified < _program.comment_count &&
+           _program.comments[_notified].token < _index)
+      ++_notified;
+  }
+
+private:
+  static constexpr auto &_program = StaticStream<S>::program;
+  OnComment _on_comment;
+  size_t _index{0};
+  size_t _notified{0};
+  byfxxm::Location _location;
+};
+} // namespace byfxxm
+
+#endif
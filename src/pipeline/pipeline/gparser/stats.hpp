@@ -0,0 +1,117 @@
+﻿#ifndef _BYFXXM_STATS_HPP_
+#define _BYFXXM_STATS_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace byfxxm {
+// 解析统计，定义BYFXXM_GPARSER_STATS时才采集，否则埋点全部编译为空
+struct Stats {
+  size_t tokens{0};
+  size_t statements{0};
+  size_t nodes{0};
+  size_t lookups{0};
+  size_t inserts{0};
+  size_t gotos{0};
+  size_t iterations{0};
+  size_t calls{0};       // 子程序调用次数
+  size_t subprograms{0}; // 编译过的子程序个数
+
+  // 时钟周期，外层包含内层：syntax包含lexer，abstree包含ginterface
+  uint64_t lexer{0};
+  uint64_t syntax{0};
+  uint64_t abstree{0};
+  uint64_t ginterface{0};
+
+  // 并入其它线程采集的统计
+  Stats &operator+=(const Stats &other) {
+    tokens += other.tokens;
+    statements += other.statements;
+    nodes += other.nodes;
+    lookups += other.lookups;
+    inserts += other.inserts;
+    gotos += other.gotos;
+    iterations += other.iterations;
+    calls += other.calls;
+    subprograms += other.subprograms;
+    lexer += other.lexer;
+    syntax += other.syntax;
+    abstree += other.abstree;
+    ginterface += other.ginterface;
+    return *this;
+  }
+};
+
+namespace stats {
+inline uint64_t Ticks() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// 当前线程正在采集的统计
+inline thread_local Stats *current = nullptr;
+
+class Scope {
+public:
+  Scope(Stats *stats) : _prev(current) { current = stats; }
+  ~Scope() { current = _prev; }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+private:
+  Stats *_prev{nullptr};
+};
+
+class Timer {
+public:
+  Timer(uint64_t Stats::*field) : _field(field), _start(Ticks()) {}
+  ~Timer() {
+    if (current)
+      current->*_field += Ticks() - _start;
+  }
+  Timer(const Timer &) = delete;
+  Timer &operator=(const Timer &) = delete;
+
+private:
+  uint64_t Stats::*_field;
+  uint64_t _start;
+};
+} // namespace stats
+} // namespace byfxxm
+
+// 埋点展开在内联函数和模板中，各翻译单元须一致地定义或不定义该宏，否则违反ODR
+// MSVC在链接时检查，其它编译器须由构建脚本保证
+#if defined(_MSC_VER)
+#ifdef BYFXXM_GPARSER_STATS
+#pragma detect_mismatch("BYFXXM_GPARSER_STATS", "1")
+#else
+#pragma detect_mismatch("BYFXXM_GPARSER_STATS", "0")
+#endif
+#endif
+
+#ifdef BYFXXM_GPARSER_STATS
+#define byfxxm_StatsScope(ptr)                                                 \
+  byfxxm::stats::Scope _byfxxm_stats_scope(ptr)
+#define byfxxm_StatsCount(field)                                               \
+  do {                                                                         \
+    if (byfxxm::stats::current)                                                \
+      ++byfxxm::stats::current->field;                                         \
+  } while (0)
+#define byfxxm_StatsTime(field)                                                \
+  byfxxm::stats::Timer _byfxxm_stats_##field(&byfxxm::Stats::field)
+#else
+#define byfxxm_StatsScope(ptr) ((void)0)
+#define byfxxm_StatsCount(field) ((void)0)
+#define byfxxm_StatsTime(field) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+﻿#ifndef _BYFXXM_SUBPROGRAM_HPP_
+#define _BYFXXM_SUBPROGRAM_HPP_
+
+#include "common.hpp"
+#include "exception.hpp"
+#include "ginterface.hpp"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+namespace byfxxm {
+// M98/G65调用子程序，M99返回，由Syntax处理
+using CallSubprogram = std::function<void(const Ginterface::Params &)>;
+
+namespace subprogram {
+// G65宏调用，压入新的局部变量层，地址字母作为自变量
+inline bool IsMacroCall(const Ginterface::Params &params) {
+  return params.Has(token::Kind::G, 65);
+}
+
+inline bool IsCall(const Ginterface::Params &params) {
+  return params.Has(token::Kind::M, 98) || IsMacroCall(params);
+}
+
+inline bool IsReturn(const Ginterface::Params &params) {
+  return params.Has(token::Kind::M, 99);
+}
+
+// G65自变量与局部变量的对应关系，P为程序号，L为重复次数，不作自变量
+inline constexpr std::pair<token::Kind, double> arguments[] = {
+    {token::Kind::A, 1},  {token::Kind::B, 2},  {token::Kind::C, 3},
+    {token::Kind::I, 4},  {token::Kind::J, 5},  {token::Kind::K, 6},
+    {token::Kind::F, 9},  {token::Kind::M, 13}, {token::Kind::Q, 17},
+    {token::Kind::R, 18}, {token::Kind::S, 19},
+    {token::Kind::X, 24}, {token::Kind::Y, 25}, {token::Kind::Z, 26},
+};
+} // namespace subprogram
+
+// 按O号登记子程序的源码或文件，每次运行中每个子程序只编译一次
+class Subprograms {
+public:
+  void Add(double number, std::string source) {
+    _sources[number] = std::move(source);
+  }
+
+  void AddFile(double number, std::filesystem::path path) {
+    _sources[number] = std::move(path);
+  }
+
+  bool Contains(double number) const { return _sources.contains(number); }
+
+  std::string Source(double number) const {
+    auto iter = _sources.find(number);
+    if (iter == _sources.end())
+      throw AbstreeException("subprogram not found");
+
+    return std::visit(
+        Overloaded{[](const std::string &source) { return source; },
+                   [](const std::filesystem::path &path) {
+                     std::ifstream file(path);
+                     if (!file)
+                       throw AbstreeException("subprogram file error");
+
+                     return std::string(std::istreambuf_iterator<char>(file),
+                                        {});
+                   }},
+        iter->second);
+  }
+
+private:
+  std::unordered_map<double, std::variant<std::string, std::filesystem::path>>
+      _sources;
+};
+} // namespace byfxxm
+
+#endif
@@ -6,6 +6,8 @@
 #include "block.hpp"
 #include "grammar.hpp"
 #include "lexer.hpp"
+#include "subprogram.hpp"
+#include <sstream>
 
 namespace byfxxm {
 inline Segment *GetSegment(UniquePtr<block::Block> &block) {
@@ -20,56 +22,222 @@ inline Segment *GetSegment(UniquePtr<block::Block> &block) {
   return {};
 }
 
-using AbstreeTuple = std::tuple<Abstree, Snapshot>;
+template <GinterfaceConcept G>
+using BasicAbstreeTuple = std::tuple<BasicAbstree<G>, Snapshot>;
+using AbstreeTuple = BasicAbstreeTuple<Ginterface>;
 
-template <StreamConcept T> class Syntax {
+// 从词法中读取顶层语句，并跟踪当前位置
+template <StreamConcept T> class Reader {
 public:
-  Syntax(T &&stream, Address *addr, Ginterface *gimpl)
-      : _lex(std::move(stream)), _addr(addr), _gimpl(gimpl) {}
+  Reader(T &&stream, const GetRetVal &get_rval,
+         const OnComment &on_comment = {})
+      : _lex(std::move(stream), on_comment), _get_rval(get_rval) {}
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  std::optional<Statement> Next() {
+    ParseError err;
+    auto stmt = GetStatement(
+        grammar::Utils{_get, _peek, _get_rval, _get_snapshot, err});
+    if (err)
+      Throw(err);
+
+    return stmt;
+  }
+
+  const Snapshot &GetSnapshot() const { return _snapshot; }
+
+  // 跳到snapshot所在行的行首
+  void Seek(const Snapshot &snapshot) {
+    _snapshot = snapshot;
+    _lex.Seekg(_snapshot.pos);
+    _snapshot.pos = _lex.BackToBeginningOfLine();
+  }
+
+private:
+  Lexer<T> _lex;
+  Snapshot _snapshot{1, 0};
+  const GetRetVal _get_rval;
+  const grammar::Get _get = [this]() {
+    auto tok = _lex.Get();
+    _snapshot.pos = _lex.Tellg();
+    if (tok.kind == token::Kind::NEWLINE)
+      ++_snapshot.line;
+
+    return tok;
+  };
+  const grammar::Peek _peek = [this]() { return _lex.Peek(); };
+  const byfxxm::GetSnapshot _get_snapshot = [this]() { return _snapshot; };
+};
+
+template <StreamConcept T, GinterfaceConcept G = Ginterface> class Syntax {
+public:
+  using AbstreeTuple = BasicAbstreeTuple<G>;
+
+  Syntax(T &&stream, Address *addr, G *gimpl,
+         const OnComment &on_comment = {})
+      : _reader(
+            std::move(stream), [this]() { return _return_val; }, on_comment),
+        _addr(addr), _gimpl(gimpl) {}
 
   std::optional<AbstreeTuple> Next() {
+    byfxxm_StatsTime(syntax);
     try {
-      if (auto seg = GetSegment(_remain_block))
+      // 正在执行的子程序优先，返回后继续调用处未执行完的代码块
+      if (auto seg = _CalledSegment())
         return _ToAbstreeTuple(*seg);
 
-      auto peek = [this]() { return _lex.Peek(); };
-      auto get = [this]() {
-        auto tok = _lex.Get();
-        _snapshot.pos = _lex.Tellg();
-        if (tok.kind == token::Kind::NEWLINE)
-          ++_snapshot.line;
-
-        return tok;
-      };
-      auto get_rval = [this]() { return _return_val; };
+      if (auto seg = GetSegment(_remain_block))
+        return _ToAbstreeTuple(*seg);
 
-      if (auto stmt =
-              GetStatement(grammar::Utils{get, peek, get_rval, _get_snapshot}))
+      if (auto stmt = _reader.Next())
         return _ToAbstreeTuple(std::move(stmt.value()));
 
       return {};
     } catch (const ParseException &ex) {
-      throw SyntaxException(_snapshot.line, ex.what());
+      throw SyntaxException(_reader.GetSnapshot().line, ex.what());
     }
   }
 
+  // 没有未执行完的代码块和子程序，下一条语句从词法中读取
+  bool AtTopLevel() const { return !_remain_block && _calls.empty(); }
+
+  // 当前代码块的起始行，子程序中返回调用处所在行，顶层语句返回0
+  size_t BlockLine() const {
+    return _remain_block ? _block_line : _calls.empty() ? 0 : _line;
+  }
+
+  // Next返回的段在子程序中时为调用处所在的主程序行，否则为0
+  size_t CallerLine() const { return _calls.empty() ? 0 : _line; }
+
+  // Next返回的是最外层代码块所在行的段，即最外层WHILE每轮开始时的条件
+  // 此时的#变量与从该行重新进入代码块时相同，可以从这里恢复
+  bool AtBlockHead(const Snapshot &snapshot) const {
+    return _remain_block && _calls.empty() && snapshot.line == _block_line;
+  }
+
+  const SnapshotTable &GetSnapshotTable() const { return _snapshot_table; }
+
+  // 恢复到某个顶层语句或最外层代码块的开始处
+  void Restore(const Snapshot &snapshot, const SnapshotTable &table) {
+    _snapshot_table = table;
+    _calls.clear();
+    _goto_snapshot(snapshot);
+  }
+
+  // line行之前的语句不调用Ginterface
+  void FastForward(size_t line) { _forward_line = line; }
+
+  // M98/G65按O号到subprograms中查找子程序
+  void SetSubprograms(const Subprograms *subprograms) {
+    _subprograms = subprograms;
+  }
+
 private:
+  // 子程序中的段按调用处所在行判断，到达line行后不再跳过
+  G *_Ginterface(const Snapshot &snapshot) {
+    if (_calls.empty())
+      _line = snapshot.line;
+
+    if (_line < _forward_line)
+      return nullptr;
+
+    _forward_line = 0;
+    return _gimpl;
+  }
+
   AbstreeTuple _ToAbstreeTuple(Segment &seg) {
     auto &[root, snapshot] = seg;
-    return {Abstree(root, _return_val, _addr, _gimpl,
-                    {_get_snapshot, _mark_snapshot, _goto_snapshot,
-                     _snapshot_table}),
+    return {BasicAbstree<G>(root, _return_val, _addr, _Ginterface(snapshot),
+                            {_get_snapshot, _mark_snapshot, _goto_snapshot,
+                             _snapshot_table, _call_subprogram}),
             snapshot};
   }
 
   AbstreeTuple _ToAbstreeTuple(Segment &&seg) {
     auto &[root, snapshot] = seg;
-    return {Abstree(std::move(root), _return_val, _addr, _gimpl,
-                    {_get_snapshot, _mark_snapshot, _goto_snapshot,
-                     _snapshot_table}),
+    return {BasicAbstree<G>(std::move(root), _return_val, _addr,
+                            _Ginterface(snapshot),
+                            {_get_snapshot, _mark_snapshot, _goto_snapshot,
+                             _snapshot_table, _call_subprogram}),
             snapshot};
   }
 
+  Segment *_CalledSegment() {
+    while (!_calls.empty()) {
+      auto &call = _calls.back();
+      if (auto seg = GetSegment(*call.scope, call.index))
+        return seg;
+
+      if (--call.count > 0) {
+        ResetScope(*call.scope);
+        call.index = 0;
+        continue;
+      }
+
+      if (call.frame)
+        _addr->PopFrame();
+
+      _calls.pop_back();
+    }
+
+    return {};
+  }
+
+  // 子程序只在第一次调用时词法、语法分析，之后重复执行同一份语句
+  Scope &_Compile(double number) {
+    if (auto iter = _compiled.find(number); iter != _compiled.end())
+      return iter->second;
+
+    if (!_subprograms)
+      throw AbstreeException("subprogram not found");
+
+    byfxxm_StatsCount(subprograms);
+    Reader<std::istringstream> reader(
+        std::istringstream(_subprograms->Source(number)),
+        [this]() { return _return_val; });
+    Scope scope{&Mempool()};
+    while (auto stmt = reader.Next())
+      scope.push_back(std::move(stmt.value()));
+
+    return _compiled.emplace(number, std::move(scope)).first->second;
+  }
+
+  void _Call(const Ginterface::Params &params) {
+    if (!params.Has(token::Kind::P))
+      throw AbstreeException("subprogram error");
+
+    auto count = params.Get(token::Kind::L, 1);
+    if (count < 1 || count != static_cast<size_t>(count))
+      throw AbstreeException("subprogram error");
+
+    auto &scope = _Compile(params[token::Kind::P]);
+    // 语句中的代码块保存了执行状态，同一子程序不能重入
+    if (std::ranges::any_of(_calls,
+                            [&](auto &&call) { return call.scope == &scope; }))
+      throw AbstreeException("subprogram recursion");
+
+    auto frame = subprogram::IsMacroCall(params);
+    if (frame) {
+      _addr->PushFrame();
+      for (auto &[code, key] : subprogram::arguments) {
+        if (params.Has(code))
+          (*_addr)[key] = params[code];
+      }
+    }
+
+    byfxxm_StatsCount(calls);
+    ResetScope(scope);
+    _calls.push_back({&scope, 0, static_cast<size_t>(count), frame});
+  }
+
+  // 结束本次执行，L指定的剩余次数照常执行
+  void _Return() {
+    if (!_calls.empty())
+      _calls.back().index = _calls.back().scope->size();
+  }
+
   AbstreeTuple _ToAbstreeTuple(Statement &&stmt) {
     return std::visit(
         Overloaded{
@@ -80,30 +248,54 @@ private:
               _remain_block = std::move(block_);
               auto seg = GetSegment(_remain_block);
               assert(seg);
+              _block_line = std::get<Snapshot>(*seg).line;
               return _ToAbstreeTuple(*seg);
             },
         },
         std::move(stmt));
   }
 
+  struct _Called {
+    Scope *scope{nullptr};
+    size_t index{0};
+    size_t count{1}; // 剩余执行次数
+    bool frame{false};
+  };
+
 private:
-  Lexer<T> _lex;
+  Reader<T> _reader;
   Value _return_val;
   Address *_addr{nullptr};
-  Ginterface *_gimpl{nullptr};
+  G *_gimpl{nullptr};
   UniquePtr<block::Block> _remain_block;
-  Snapshot _snapshot{1, 0};
+  size_t _block_line{0};
+  size_t _forward_line{0};
+  size_t _line{0}; // 最近一条主程序语句所在行
   SnapshotTable _snapshot_table;
-  const GetSnapshot _get_snapshot = [this]() { return _snapshot; };
+  const Subprograms *_subprograms{nullptr};
+  std::unordered_map<double, Scope> _compiled;
+  std::vector<_Called> _calls;
+  const GetSnapshot _get_snapshot = [this]() { return _reader.GetSnapshot(); };
+  // 子程序中的N标号和GOTO对应的是子程序源码中的位置，不支持
   const MarkSnapshot _mark_snapshot = [this](double k) {
-    _snapshot_table[k] = _snapshot;
+    if (_calls.empty())
+      _snapshot_table[k] = _reader.GetSnapshot();
   };
   const GotoSnapshot _goto_snapshot = [this](const Snapshot &snapshot) {
-    _snapshot = snapshot;
+    if (!_calls.empty())
+      throw AbstreeException("goto in subprogram");
+
+    byfxxm_StatsCount(gotos);
     _remain_block.reset();
-    _lex.Seekg(_snapshot.pos);
-    _snapshot.pos = _lex.BackToBeginningOfLine();
+    _reader.Seek(snapshot);
   };
+  const CallSubprogram _call_subprogram =
+      [this](const Ginterface::Params &params) {
+        if (subprogram::IsReturn(params))
+          _Return();
+        else
+          _Call(params);
+      };
 };
 
 template <class T> Syntax(T) -> Syntax<T>;
@@ -1,9 +1,12 @@
 ﻿#ifndef _BYFXXM_TOKEN_HPP_
 #define _BYFXXM_TOKEN_HPP_
 
+#include <algorithm>
 #include <functional>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <variant>
 
@@ -60,6 +63,10 @@ enum class Kind {
   F,
   S,
   O,
+  P,
+  L,
+  R,
+  Q,
 };
 
 struct Token {
@@ -69,7 +76,13 @@ struct Token {
 
 using Dictionary = std::pmr::unordered_map<std::string, Kind>;
 
-inline const Dictionary keywords = {
+// 拼写表，编译期词法分析直接使用，运行期转换为Dictionary
+struct Spelling {
+  std::string_view word;
+  Kind kind;
+};
+
+inline constexpr Spelling keyword_spellings[] = {
     {"IF", Kind::IF},       {"ELSEIF", Kind::ELSEIF}, {"ELSE", Kind::ELSE},
     {"ENDIF", Kind::ENDIF}, {"THEN", Kind::THEN},     {"WHILE", Kind::WHILE},
     {"DO", Kind::DO},       {"END", Kind::END},       {"GT", Kind::GT},
@@ -77,19 +90,32 @@ inline const Dictionary keywords = {
     {"EQ", Kind::EQ},       {"NE", Kind::NE},         {"MAX", Kind::MAX},
     {"MIN", Kind::MIN},     {"NOT", Kind::NOT},       {"GOTO", Kind::GOTO}};
 
-inline const Dictionary symbols = {
+inline constexpr Spelling symbol_spellings[] = {
     {"[", Kind::LB},     {"]", Kind::RB},   {"+", Kind::PLUS},
     {"-", Kind::MINUS},  {"*", Kind::MUL},  {"/", Kind::DIV},
     {"=", Kind::ASSIGN}, {";", Kind::SEMI}, {",", Kind::COMMA},
 };
 
-inline const Dictionary gcodes = {
+inline constexpr Spelling gcode_spellings[] = {
     {"G", Kind::G}, {"M", Kind::M}, {"X", Kind::X}, {"Y", Kind::Y},
     {"Z", Kind::Z}, {"A", Kind::A}, {"B", Kind::B}, {"C", Kind::C},
     {"I", Kind::I}, {"J", Kind::J}, {"K", Kind::K}, {"N", Kind::N},
-    {"F", Kind::F}, {"S", Kind::S}, {"O", Kind::O},
+    {"F", Kind::F}, {"S", Kind::S}, {"O", Kind::O}, {"P", Kind::P},
+    {"L", Kind::L}, {"R", Kind::R}, {"Q", Kind::Q},
 };
 
+inline Dictionary _MakeDictionary(std::span<const Spelling> spellings) {
+  Dictionary dict;
+  for (auto &[word, kind] : spellings)
+    dict.emplace(std::string(word), kind);
+
+  return dict;
+}
+
+inline const Dictionary keywords = _MakeDictionary(keyword_spellings);
+inline const Dictionary symbols = _MakeDictionary(symbol_spellings);
+inline const Dictionary gcodes = _MakeDictionary(gcode_spellings);
+
 inline bool _IsMapping(const Dictionary &dict, const std::string &word) {
   return dict.contains(word);
 }
@@ -126,18 +152,44 @@ inline bool IsGcode(const std::string &word) {
   return _IsMapping(gcodes, word);
 }
 
+// 二进制模式读入的CRLF中\r按空白跳过
 inline constexpr char spaces[] = {
     ' ',
     '\t',
+    '\r',
 };
 
-inline bool IsSpace(char ch) {
+inline constexpr bool IsSpace(char ch) {
   return std::ranges::find(spaces, ch) != std::end(spaces);
 }
 
 inline constexpr bool IsSharp(char ch) { return ch == '#'; }
 
 inline constexpr bool IsNewline(char ch) { return ch == '\n'; }
+
+// 以下规则运行时和编译期词法共用
+inline constexpr bool IsDigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+inline constexpr bool IsNumeric(char ch) { return IsDigit(ch) || ch == '.'; }
+
+// 常量以数字开头，由数字和至多一个小数点组成
+inline constexpr bool IsNumber(std::string_view word) {
+  return !word.empty() && IsDigit(word.front()) &&
+         std::ranges::all_of(word, IsNumeric) &&
+         std::ranges::count(word, '.') <= 1;
+}
+
+// +-在常量和]之后为加减，在其它单词之后为正负号，第一个单词按加减处理
+inline constexpr Kind ResolveSign(Kind sym, std::optional<Kind> last) {
+  if (!last || *last == Kind::CON || *last == Kind::RB)
+    return sym;
+
+  if (sym == Kind::PLUS)
+    return Kind::POS;
+  if (sym == Kind::MINUS)
+    return Kind::NEG;
+  return sym;
+}
 } // namespace token
 } // namespace byfxxm
 
@@ -0,0 +1,63 @@
+﻿#ifndef _BYFXXM_VALIDATOR_HPP_
+#define _BYFXXM_VALIDATOR_HPP_
+
+#include "grammar.hpp"
+#include "lexer.hpp"
+#include <string>
+#include <vector>
+
+namespace byfxxm {
+struct Diagnostic {
+  size_t line{};
+  size_t column{};
+  errc code{errc::SYNTAX};
+  std::string error;
+};
+
+using Diagnostics = std::vector<Diagnostic>;
+
+// 只做词法和语法检查，不执行，不调用Ginterface
+// 出错后丢弃该行剩余内容，从下一行恢复，收集全部错误
+// 词法和语法错误都通过返回值报告，不抛异常
+template <StreamConcept T> class Validator {
+public:
+  Validator(T &&stream) : _lex(std::move(stream)) {}
+
+  Diagnostics operator()() {
+    Diagnostics diags;
+    Value rval;
+    const grammar::Get get = [this]() { return _lex.TryGet(); };
+    const grammar::Peek peek = [this]() { return _lex.TryPeek(); };
+    const GetRetVal get_rval = [&rval]() { return rval; };
+    const GetSnapshot get_snapshot = [this]() {
+      return Snapshot{_lex.Location().line, _lex.Tellg()};
+    };
+
+    for (;;) {
+      ParseError err;
+      auto stmt =
+          grammar::GetStatement({get, peek, get_rval, get_snapshot, err});
+      // 词法错误使语法分析提前结束，以词法错误为准
+      if (_lex.Error())
+        err = {errc::LEX, _lex.Error()};
+
+      if (err) {
+        auto loc = _lex.Location();
+        diags.push_back({loc.line, loc.column, err.code, err.error});
+        _lex.SkipLine();
+        continue;
+      }
+
+      if (!stmt)
+        break;
+    }
+
+    return diags;
+  }
+
+private:
+  Lexer<T> _lex;
+};
+} // namespace byfxxm
+
+#endif
@@ -1,6 +1,7 @@
 ﻿#ifndef _BYFXXM_WORD_HPP_
 #define _BYFXXM_WORD_HPP_
 
+#include <charconv>
 #include <functional>
 
 namespace byfxxm {
@@ -33,19 +34,28 @@ class Sharp : public Word {
 };
 
 class Constant : public Word {
-  virtual bool First(char ch) const override { return isdigit(ch); }
+  virtual bool First(char ch) const override { return token::IsDigit(ch); }
 
   virtual std::optional<token::Token> Rest(std::string &word,
                                            const Utils &utils) const override {
     for (;;) {
       auto ch = utils.peek();
-      if (!std::isdigit(ch) && ch != '.')
+      if (!token::IsNumeric(ch))
         break;
 
       word.push_back(utils.get());
     }
 
-    return token::Token{token::Kind::CON, std::stod(word)};
+    // 多个小数点或超出范围时为词法错误
+    if (!token::IsNumber(word))
+      return {};
+
+    double value{};
+    if (std::from_chars(word.data(), word.data() + word.size(), value).ec !=
+        std::errc{})
+      return {};
+
+    return token::Token{token::Kind::CON, value};
   }
 };
 
@@ -75,19 +85,12 @@ class Symbol : public Word {
   virtual std::optional<token::Token> Rest(std::string &word,
                                            const Utils &utils) const override {
     if (!token::symbols.contains(word))
-      throw LexException();
-
-    auto sym = token::symbols.at(word);
-    auto last_ = utils.last();
-    if (sym == token::Kind::PLUS && last_.has_value() &&
-        last_.value().kind != token::Kind::CON &&
-        last_.value().kind != token::Kind::RB)
-      sym = token::Kind::POS;
-    else if (sym == token::Kind::MINUS && last_.has_value() &&
-             last_.value().kind != token::Kind::CON &&
-             last_.value().kind != token::Kind::RB)
-      sym = token::Kind::NEG;
+      return {};
 
+    auto &last_ = utils.last();
+    auto sym = token::ResolveSign(
+        token::symbols.at(word),
+        last_ ? std::optional(last_->kind) : std::nullopt);
     return token::Token{sym, {}};
   }
 };
@@ -97,6 +100,9 @@ class Gcode : public Word {
 
   virtual std::optional<token::Token> Rest(std::string &word,
                                            const Utils &utils) const override {
+    if (!token::gcodes.contains(word))
+      return {};
+
     return token::Token{token::gcodes.at(word), nan};
   }
 };
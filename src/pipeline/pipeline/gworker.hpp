@@ -21,87 +21,91 @@ inline void print_gparams(std::string str, const Ginterface::Params &params) {
   puts(str.c_str());
 }
 
-inline AxesArray GparamsToEnd(const Ginterface::Params &params) {
-  AxesArray ret(6);
-  ret.Memset(nan);
-  std::ranges::for_each(params, [&](const Gtag &item) {
-    switch (item.code) {
-    case token::Kind::X:
-      ret[0] = item.value;
-      break;
-    case token::Kind::Y:
-      ret[1] = item.value;
-      break;
-    case token::Kind::Z:
-      ret[2] = item.value;
-      break;
-    default:
-      break;
-    }
-  });
-
+inline Axes MakeAxes(double x, double y, double z) {
+  Axes ret;
+  ret.fill(nan);
+  ret[0] = x;
+  ret[1] = y;
+  ret[2] = z;
   return ret;
 }
 
-inline AxesArray GparamsToCenter(const Ginterface::Params &params) {
-  AxesArray ret(6);
-  ret.Memset(nan);
-  std::ranges::for_each(params, [&](const Gtag &item) {
-    switch (item.code) {
-    case token::Kind::I:
-      ret[0] = item.value;
-      break;
-    case token::Kind::J:
-      ret[1] = item.value;
-      break;
-    case token::Kind::K:
-      ret[2] = item.value;
-      break;
-    default:
-      break;
-    }
-  });
+inline Axes GparamsToAxes(const Ginterface::Params &params, token::Kind x,
+                          token::Kind y, token::Kind z) {
+  return MakeAxes(params.Get(x, nan), params.Get(y, nan), params.Get(z, nan));
+}
 
-  return ret;
+// 段中有坐标或圆心
+inline bool HasAxes(const Ginterface::Params &params) {
+  constexpr auto axes =
+      Gparams::Bit(token::Kind::X) | Gparams::Bit(token::Kind::Y) |
+      Gparams::Bit(token::Kind::Z) | Gparams::Bit(token::Kind::I) |
+      Gparams::Bit(token::Kind::J) | Gparams::Bit(token::Kind::K);
+  return params.Mask() & axes;
+}
+
+inline Axes GparamsToEnd(const Ginterface::Params &params) {
+  return GparamsToAxes(params, token::Kind::X, token::Kind::Y, token::Kind::Z);
 }
 
-class Gimpl : public Ginterface {
+inline Axes GparamsToCenter(const Ginterface::Params &params) {
+  return GparamsToAxes(params, token::Kind::I, token::Kind::J, token::Kind::K);
+}
+
+// C为输出的码，见BasicWorker
+template <class C> class BasicGimpl : public Ginterface {
 public:
-  Gimpl(const WriteFunc &writefn) : _writefn(writefn) {}
+  BasicGimpl(const BasicWriteFunc<C> &writefn) : _writefn(writefn) {}
 
+  // 沿用模态指令，段中没有坐标时不输出，只更新G98/G99等模态
   virtual void None(const Utils &utils) override {
-    if (_last == Gtag{token::Kind::G, 0})
-      _writefn(std::make_unique<Move>(GparamsToEnd(utils.params)));
+    _SetModal(utils.params);
+    if (_cycle.code != 0) {
+      _SetCycle(utils.params);
+      if (utils.params.Has(token::Kind::X) || utils.params.Has(token::Kind::Y))
+        _Drill(utils.params);
+    } else if (!HasAxes(utils.params)) {
+      return;
+    } else if (_last == Gtag{token::Kind::G, 0})
+      _Write<record::Move>(GparamsToEnd(utils.params));
     else if (_last == Gtag{token::Kind::G, 1})
-      _writefn(std::make_unique<Line>(GparamsToEnd(utils.params)));
+      _Write<record::Line>(GparamsToEnd(utils.params));
     else if (_last == Gtag{token::Kind::G, 2})
-      _writefn(std::make_unique<Arc>(GparamsToEnd(utils.params),
-                                     GparamsToCenter(utils.params), false));
+      _Write<record::Arc>(GparamsToEnd(utils.params),
+                          GparamsToCenter(utils.params), false);
     else if (_last == Gtag{token::Kind::G, 3})
-      _writefn(std::make_unique<Arc>(GparamsToEnd(utils.params),
-                                     GparamsToCenter(utils.params), true));
+      _Write<record::Arc>(GparamsToEnd(utils.params),
+                          GparamsToCenter(utils.params), true);
   }
 
   virtual void G0(const Utils &utils) override {
     _last = {token::Kind::G, 0};
-    _writefn(std::make_unique<Move>(GparamsToEnd(utils.params)));
+    _cycle = {};
+    _SetModal(utils.params);
+    _Write<record::Move>(GparamsToEnd(utils.params));
   }
 
   virtual void G1(const Utils &utils) override {
     _last = {token::Kind::G, 1};
-    _writefn(std::make_unique<Line>(GparamsToEnd(utils.params)));
+    _cycle = {};
+    _SetModal(utils.params);
+    _Write<record::Line>(GparamsToEnd(utils.params));
   }
 
   virtual void G2(const Utils &utils) override {
     _last = {token::Kind::G, 2};
-    _writefn(std::make_unique<Arc>(GparamsToEnd(utils.params),
-                                   GparamsToCenter(utils.params), false));
+    _cycle = {};
+    _SetModal(utils.params);
+    _Write<record::Arc>(GparamsToEnd(utils.params),
+                        GparamsToCenter(utils.params), false);
   }
 
   virtual void G3(const Utils &utils) override {
     _last = {token::Kind::G, 3};
-    _writefn(std::make_unique<Arc>(GparamsToEnd(utils.params),
-                                   GparamsToCenter(utils.params), true));
+    _cycle = {};
+    _SetModal(utils.params);
+    _Write<record::Arc>(GparamsToEnd(utils.params),
+                        GparamsToCenter(utils.params), true);
   }
 
   virtual void G4(const Utils &utils) override {
@@ -112,28 +116,145 @@ public:
     print_gparams("N", utils.params);
   }
 
+  // 固定循环直接展开为Move/Line，孔位、Z、R、Q保持模态直到G80或G0~G3
+  // 暂停、主轴正反转和定向没有对应的Code，不输出
+  virtual void Cycle(const Utils &utils) override {
+    _SetModal(utils.params);
+    if (utils.value == 80) {
+      _cycle = {};
+      return;
+    }
+
+    if (_cycle.code == 0)
+      _cycle.initial = _pos[2];
+
+    _cycle.code = utils.value;
+    _SetCycle(utils.params);
+    _Drill(utils.params);
+  }
+
+private:
+  struct _Cycle {
+    double code{0}; // 0表示没有进行中的固定循环
+    double z{nan};
+    double r{nan};
+    double q{nan};
+    double initial{nan}; // 初始平面，进入循环时的Z
+  };
+
+  // 深孔循环每次回退后快速下降到离上次深度还有该距离处，G73每次回退该距离
+  static constexpr double _peck_clearance = 1.0;
+
+  // T为record中的类型，按C写出记录或转换为多态码
+  template <class T, class... Args>
+  void _Write(const Axes &end, Args &&...args) {
+    for (size_t i = 0; i < _pos.size(); ++i) {
+      if (!IsNaN(end[i]))
+        _pos[i] = end[i];
+    }
+
+    if constexpr (std::is_same_v<C, CodeRecord>)
+      _writefn(T{end, std::forward<Args>(args)...});
+    else
+      _writefn(ToCode(T{end, std::forward<Args>(args)...}));
+  }
+
+  void _SetCycle(const Params &params) {
+    _cycle.z = params.Get(token::Kind::Z, _cycle.z);
+    _cycle.r = params.Get(token::Kind::R, _cycle.r);
+    _cycle.q = params.Get(token::Kind::Q, _cycle.q);
+  }
+
+  // G98/G99与其它G字可以在同一段中，如G99 G90 G81，不随循环取消而复位
+  void _SetModal(const Params &params) {
+    if (params.Has(token::Kind::G, 98))
+      _to_initial = true;
+    else if (params.Has(token::Kind::G, 99))
+      _to_initial = false;
+  }
+
+  void _Drill(const Params &params) {
+    auto [code, z, r, q, initial] = _cycle;
+    if (IsNaN(z) || IsNaN(r))
+      throw AbstreeException("cycle error");
+
+    if (IsNaN(initial))
+      initial = r;
+
+    _Write<record::Move>(MakeAxes(params.Get(token::Kind::X, nan),
+                                  params.Get(token::Kind::Y, nan), nan));
+    if (_pos[2] != r)
+      _Write<record::Move>(MakeAxes(nan, nan, r));
+
+    // G87背镗：R点在孔底，向上切削到Z，退回初始平面
+    if (code == 87) {
+      _Write<record::Line>(MakeAxes(nan, nan, z));
+      _Write<record::Move>(MakeAxes(nan, nan, initial));
+      return;
+    }
+
+    if ((code == 73 || code == 83) && q > 0) {
+      auto dir = z < r ? -1.0 : 1.0;
+      for (auto depth = r; depth != z;) {
+        auto next = (z - depth - dir * q) * dir > 0 ? depth + dir * q : z;
+        if (depth != r && code == 83)
+          _Write<record::Move>(
+              MakeAxes(nan, nan, depth - dir * _peck_clearance));
+
+        _Write<record::Line>(MakeAxes(nan, nan, next));
+        if (next != z) {
+          _Write<record::Move>(MakeAxes(
+              nan, nan, code == 83 ? r : next - dir * _peck_clearance));
+        }
+
+        depth = next;
+      }
+    } else {
+      _Write<record::Line>(MakeAxes(nan, nan, z));
+    }
+
+    // 攻丝和镗孔以进给速度退出到R点
+    if (code == 74 || code == 84 || code == 85 || code == 89)
+      _Write<record::Line>(MakeAxes(nan, nan, r));
+
+    auto ret = _to_initial ? initial : r;
+    if (_pos[2] != ret)
+      _Write<record::Move>(MakeAxes(nan, nan, ret));
+  }
+
 private:
   Gtag _last{token::Kind::G, 0};
-  WriteFunc _writefn;
+  BasicWriteFunc<C> _writefn;
+  _Cycle _cycle;
+  bool _to_initial{true}; // G98返回初始平面，G99返回R平面
+  std::array<double, 3> _pos{nan, nan, nan}; // 当前位置，未知时为nan
 };
 
-class Gworker : public Worker {
+template <class C> class BasicGworker : public BasicWorker<C> {
 public:
-  Gworker(StreamConcept auto &&stream)
+  BasicGworker(StreamConcept auto &&stream)
       : _parser(std::forward<decltype(stream)>(stream)) {}
 
 private:
-  virtual bool Do(std::unique_ptr<Code>,
-                  const WriteFunc &writefn) noexcept override {
+  virtual bool Do(CodeArg<C>,
+                  const BasicWriteFunc<C> &writefn) noexcept override {
     Address addr;
-    Gimpl gimpl(writefn);
+    BasicGimpl<C> gimpl(writefn);
     _parser.Run(&addr, &gimpl);
     return true;
   }
 
+  // 解析在当前语句执行完后结束，Do随之返回
+  virtual void Stop() noexcept override { _parser.Stop(); }
+
 private:
   Gparser _parser;
 };
+
+using Gimpl = BasicGimpl<std::unique_ptr<Code>>;
+using Gworker = BasicGworker<std::unique_ptr<Code>>;
+using RecordGimpl = BasicGimpl<CodeRecord>;
+using RecordGworker = BasicGworker<CodeRecord>;
 } // namespace byfxxm
 
 #endif
@@ -1,6 +1,7 @@
 ﻿#ifndef _BYFXXM_ARRAY_ND_HPP_
 #define _BYFXXM_ARRAY_ND_HPP_
 
+#include "recycler.hpp"
 #include <array>
 #include <cassert>
 #include <concepts>
@@ -69,7 +70,7 @@ public:
   MdArray(Args &&...args)
       : _count((... * std::forward<Args>(args))),
         _shapes{static_cast<size_t>(args)...} {
-    _elems = std::make_unique<Ty[]>(_count);
+    _elems = _Allocate(_count);
     Memset(0);
     _InitializeFactors();
   }
@@ -82,7 +83,7 @@ public:
       _count *= it;
     }
 
-    _elems = std::make_unique<Ty[]>(_count);
+    _elems = _Allocate(_count);
     Memset(0);
     _InitializeFactors();
     _Assignment(list, 0, 0);
@@ -90,7 +91,7 @@ public:
 
   MdArray(const MdArray &rhs)
       : _count(rhs._count), _shapes(rhs._shapes), _factors(rhs._factors) {
-    _elems = std::make_unique<Ty[]>(_count);
+    _elems = _Allocate(_count);
     std::copy(rhs._elems.get(), rhs._elems.get() + _count, _elems.get());
   }
 
@@ -138,6 +139,22 @@ public:
   Ty *end() const { return _elems.get() + _count; }
 
 private:
+  // 元素为平凡类型，直接使用Recycler分配的内存
+  struct _Deleter {
+    void operator()(Ty *elems) const {
+      Recycler::Deallocate(elems, count * sizeof(Ty));
+    }
+
+    size_t count{0};
+  };
+
+  using _Elems = std::unique_ptr<Ty[], _Deleter>;
+
+  static _Elems _Allocate(size_t count) {
+    return _Elems(static_cast<Ty *>(Recycler::Allocate(count * sizeof(Ty))),
+                  _Deleter{count});
+  }
+
   void _InitializeShapes(std::initializer_list<Ty> list, size_t index) {
     if (auto list_size = list.size(); list_size > _shapes[index]) {
       _shapes[index] = list_size;
@@ -181,7 +198,7 @@ private:
   size_t _count{0};
   std::array<size_t, Num> _shapes;
   std::array<size_t, Num> _factors;
-  std::unique_ptr<Ty[]> _elems;
+  _Elems _elems;
 };
 
 template <class First, class... Rest>
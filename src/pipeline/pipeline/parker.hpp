@@ -0,0 +1,78 @@
+﻿#ifndef _BYFXXM_PARKER_HPP_
+#define _BYFXXM_PARKER_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace byfxxm {
+// 线程模式下读写阻塞时的等待策略：先自旋spins次，再让出时间片yields次，最后挂起
+struct WaitPolicy {
+  size_t spins{256};
+  size_t yields{16};
+  bool pin{false}; // 每个工位的线程绑定到一个核
+};
+
+inline void CpuRelax() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) ||             \
+    defined(__i386__)
+  _mm_pause();
+#endif
+}
+
+// 单个等待者的挂起与唤醒，等待者和通知者各自只有一个线程
+class Parker {
+public:
+  // 条件满足时返回，ready须读取对端发布的数据
+  template <class Pred> void Wait(Pred &&ready, const WaitPolicy &policy) {
+    for (size_t i = 0; i < policy.spins; ++i) {
+      if (ready())
+        return;
+
+      CpuRelax();
+    }
+
+    for (size_t i = 0; i < policy.yields; ++i) {
+      if (ready())
+        return;
+
+      std::this_thread::yield();
+    }
+
+    for (;;) {
+      auto epoch = _epoch.load(std::memory_order_relaxed);
+      _sleeping.store(true, std::memory_order_relaxed);
+      // 与Notify中的屏障配对，要么这里看到数据，要么Notify看到_sleeping
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ready()) {
+        _sleeping.store(false, std::memory_order_relaxed);
+        return;
+      }
+
+      _epoch.wait(epoch, std::memory_order_relaxed);
+      _sleeping.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // 发布数据之后调用，等待者未挂起时只有一次屏障和读取
+  void Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleeping.load(std::memory_order_relaxed)) {
+      _epoch.fetch_add(1, std::memory_order_relaxed);
+      _epoch.notify_one();
+    }
+  }
+
+private:
+  std::atomic<uint32_t> _epoch{0};
+  std::atomic<bool> _sleeping{false};
+};
+} // namespace byfxxm
+
+#endif
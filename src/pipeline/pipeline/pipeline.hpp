@@ -2,122 +2,282 @@
 #define _BYFXXM_PIPELINE_HPP_
 
 #include "coro.hpp"
-#include "ring_buffer.hpp"
-#include "worker.hpp"
+#include "recycler.hpp"
+#include "run_pipeline.hpp"
+#include <algorithm>
+#include <array>
 #include <memory>
+#include <thread>
+#include <utility>
 #include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#endif
 
 namespace byfxxm {
-struct Code;
-class Worker;
-using Fifo = RingBuffer<std::unique_ptr<Code>, 4>;
-
-struct Station {
-  std::unique_ptr<Worker> worker;
-  std::unique_ptr<Fifo> next = std::make_unique<Fifo>();
-  Fifo *prev = nullptr;
-  bool done = false;
+// 协程模式下按阻塞情况调整Fifo的容量
+// 写入时已满则加倍，读空时自上次读空以来取走的码不到容量的1/4则减半
+struct FifoPolicy {
+  size_t min{default_fifo_capacity};
+  size_t max{1024};    // 单个Fifo的容量上限
+  size_t total{16384}; // 所有Fifo的容量之和上限
 };
 
-struct PipelineException : public std::exception {
-public:
-  PipelineException() = default;
-  PipelineException(std::string err) : _error(std::move(err)) {}
-
-private:
-  std::string _error;
-};
+// 在BasicRunPipeline的基础上增加协程和线程模式，见Start
+template <class C> class BasicPipeline : public BasicRunPipeline<C> {
+  using _Base = BasicRunPipeline<C>;
 
-class Pipeline {
 public:
+  using Fifo = BasicFifo<C>;
+  using Station = BasicStation<C>;
+  using Codes = BasicCodes<C>;
+  using WriteBatchFunc = BasicWriteBatchFunc<C>;
+  using _Base::Stop;
+
   void Start() {
     if (_station_list.empty())
       return;
 
+    _stop = false;
+    if (_threaded)
+      _StartThreads();
+    else
+      _StartFibers();
+  }
+
+  void Wait() {
+    _co.Wait();
+    _threads.clear();
+  }
+
+  // 协程模式下按policy调整各工位Fifo的容量，线程模式下不调整
+  void SetAdaptive(bool adaptive, const FifoPolicy &policy = {}) {
+    _adaptive = adaptive;
+    _fifo_policy = policy;
+  }
+
+  // 每个工位各用一个线程执行，工位之间的Fifo为单生产者单消费者队列
+  // 在Start之前设置，默认所有工位在同一线程中以协程切换执行
+  void SetThreaded(bool threaded, const WaitPolicy &policy = {}) {
+    _threaded = threaded;
+    _policy = policy;
+  }
+
+private:
+  // 返回false表示worker出错，read返回空批次或批次中有空码表示上游已结束
+  template <class Read>
+  static bool _Work(Station &sta, Read &&read, const WriteBatchFunc &write) {
+    if (sta.prev == nullptr)
+      return sta.worker->DoBatch({}, write);
+
+    for (;;) {
+      auto codes = read();
+      auto end = _FindEnd(codes);
+      auto count = static_cast<size_t>(end - codes.begin());
+      if (count > 0 && !sta.worker->DoBatch(codes.first(count), write))
+        return false;
+
+      if (codes.empty() || end != codes.end())
+        return true;
+    }
+  }
+
+  // 写入结束标记
+  static void _WriteEnd(const WriteBatchFunc &write) {
+    C end{};
+    write(Codes(&end, 1));
+  }
+
+  void _StartFibers() {
+    // 主协程只负责启动，之后阻塞的工位直接切换到能继续执行的相邻工位
+    // 全部完成或停止时才回到主协程
     _co.SetMain([this](CoMainHelper *helper, void *) {
-      while (!_stop && _cur_station < _station_list.size()) {
-        helper->SwitchToSub(_cur_station);
-      }
+      if (!_stop)
+        helper->SwitchToSub(0);
     });
 
-    for (auto &sta : _station_list) {
-      _co.AddSub([&](CoSubHelper *helper, void *) {
-        auto read = [&]() {
-          std::unique_ptr<Code> code;
-          while (!sta->prev->Read(code)) {
-            if (_cur_station > 0 && _station_list[_cur_station - 1]->done) {
-              sta->done = true;
-              ++_cur_station;
-            } else {
-              --_cur_station;
-            }
+    for (size_t i = 0; i < _station_list.size(); ++i) {
+      _co.AddSub([this, i](CoSubHelper *helper, void *) {
+        auto &sta = _station_list[i];
+        auto last = i + 1 == _station_list.size();
+        auto transfer = [&](size_t n) {
+          if (_stop)
             helper->SwitchToMain();
+          else
+            helper->SwitchToSub(n);
+        };
+
+        // 上游为空时切换到上游，上游结束时会写入空码，不会在此之前完成
+        std::array<C, batch_size> batch;
+        auto read = [&]() {
+          auto &up = *_station_list[i - 1];
+          size_t count = 0;
+          while ((count = sta->prev->ReadBulk(batch)) == 0) {
+            ++up.empty_stalls;
+            _Shrink(up);
+            up.drained = 0;
+            transfer(i - 1);
           }
 
-          return code;
+          up.drained += count;
+          return Codes(batch).first(count);
         };
 
-        auto write = [&](std::unique_ptr<Code> code) {
-          while (!sta->next->Write(std::move(code))) {
-            ++_cur_station;
-            helper->SwitchToMain();
+        // 下游已满时切换到下游，最后一个工位没有下游，丢弃
+        // 只构造一次，避免每次调用DoBatch时都从lambda构造WriteBatchFunc
+        const WriteBatchFunc write = [&](Codes codes) {
+          if (last)
+            return;
+
+          // 逐个处理的Worker每次只写一个码
+          if (codes.size() == 1 && sta->next->Write(std::move(codes[0])))
+            return;
+
+          for (;;) {
+            codes = codes.subspan(sta->next->WriteBulk(codes));
+            if (codes.empty())
+              return;
+
+            ++sta->full_stalls;
+            if (!_Grow(*sta))
+              transfer(i + 1);
           }
         };
 
-        try {
-          if (sta->prev == nullptr) {
-            if (!sta->worker->Do(nullptr, write)) {
-              throw PipelineException();
-            }
-            write(nullptr);
-          } else {
-            for (;;) {
-              auto code = read();
-              if (!code)
-                break;
-
-              if (!sta->worker->Do(std::move(code), write))
-                throw PipelineException();
-            }
-          }
-        } catch (const PipelineException &) {
+        if (!_Work(*sta, read, write)) {
           Stop();
           helper->SwitchToMain();
           return;
         }
 
         sta->done = true;
-        ++_cur_station;
-        helper->SwitchToMain();
+        _WriteEnd(write);
+        if (!last)
+          transfer(i + 1);
       });
     }
 
-    _stop = false;
     _co.AsyncRun();
   }
 
-  void Stop() { _stop = true; }
+  void _StartThreads() {
+    if (!_recycled)
+      _recycled = std::make_unique<Recycler::Channel>();
+
+    auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < _station_list.size(); ++i) {
+      auto &thr = _threads.emplace_back([this, i]() {
+        auto &sta = *_station_list[i];
+        auto up = i > 0 ? _station_list[i - 1].get() : nullptr;
+        auto last = i + 1 == _station_list.size();
+
+        // 最后一个工位释放的块交还第一个工位重新分配
+        Recycler::Scope recycle(i == 0 ? _recycled.get() : nullptr,
+                                last ? _recycled.get() : nullptr);
+
+        // 停止后读到空批次、写入直接丢弃，各Worker已收到Stop
+        // DoBatch尽快返回，线程随之结束
+        std::array<C, batch_size> batch;
+        auto read = [&]() {
+          size_t count = 0;
+          while ((count = sta.prev->ReadBulk(batch)) == 0) {
+            if (_stop)
+              break;
+
+            up->readable.Wait(
+                [&]() { return !sta.prev->IsEmpty() || _stop; }, _policy);
+          }
+
+          up->writable.Notify();
+          return Codes(batch).first(count);
+        };
+
+        const WriteBatchFunc write = [&](Codes codes) {
+          if (last)
+            return;
+
+          for (;;) {
+            codes = codes.subspan(sta.next->WriteBulk(codes));
+            sta.readable.Notify();
+            if (codes.empty() || _stop)
+              return;
+
+            sta.writable.Wait([&]() { return !sta.next->IsFull() || _stop; },
+                              _policy);
+          }
+        };
+
+        if (!_Work(sta, read, write))
+          Stop();
+
+        sta.done = true;
+        _WriteEnd(write);
+      });
+
+      if (_policy.pin)
+        _PinToCore(thr, i % cores);
+    }
+  }
+
+  // 协程模式下阻塞的一端正在执行，另一端停在切换处，可以直接改变槽数
+  bool _Grow(Station &sta) {
+    if (!_adaptive)
+      return false;
 
-  void Wait() { _co.Wait(); }
+    auto capacity = sta.Capacity();
+    auto grown = std::min(capacity * 2, _fifo_policy.max);
+    if (grown <= capacity ||
+        _total_capacity + grown - capacity > _fifo_policy.total)
+      return false;
 
-  void AddWorker(std::unique_ptr<Worker> worker) {
-    if (!worker)
-      throw PipelineException("worker is null");
+    sta.next->Resize(grown + 1);
+    _total_capacity += grown - capacity;
+    return true;
+  }
 
-    auto station = std::make_unique<Station>();
-    station->worker = std::move(worker);
-    if (!_station_list.empty())
-      station->prev = _station_list.back()->next.get();
+  void _Shrink(Station &sta) {
+    auto capacity = sta.Capacity();
+    if (!_adaptive || capacity <= _fifo_policy.min ||
+        sta.drained * 4 > capacity)
+      return;
 
-    _station_list.push_back(std::move(station));
+    auto shrunk = std::max(capacity / 2, _fifo_policy.min);
+    sta.next->Resize(shrunk + 1);
+    _total_capacity -= capacity - shrunk;
+  }
+
+  static void _PinToCore(std::jthread &thr, size_t core) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(thr.native_handle(), DWORD_PTR{1} << core);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thr.native_handle(), sizeof(set), &set);
+#else
+    (void)thr;
+    (void)core;
+#endif
   }
 
 private:
-  std::vector<std::unique_ptr<Station>> _station_list;
-  size_t _cur_station = 0;
+  using _Base::_FindEnd;
+  using _Base::_station_list;
+  using _Base::_stop;
+  using _Base::_total_capacity;
+
   Coro _co;
-  std::atomic<bool> _stop = false;
+  // 在_threads之前声明，线程结束后才析构
+  std::unique_ptr<Recycler::Channel> _recycled;
+  std::vector<std::jthread> _threads;
+  bool _threaded{false};
+  WaitPolicy _policy;
+  bool _adaptive{false};
+  FifoPolicy _fifo_policy;
 };
+
+using Pipeline = BasicPipeline<std::unique_ptr<Code>>;
+using RecordPipeline = BasicPipeline<CodeRecord>;
 } // namespace byfxxm
 
 #endif
@@ -0,0 +1,159 @@
+﻿#ifndef _BYFXXM_RECYCLER_HPP_
+#define _BYFXXM_RECYCLER_HPP_
+
+#include "ring_buffer.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <new>
+#include <utility>
+
+namespace byfxxm {
+// 按大小分级的回收分配器，释放的块挂到当前线程的空闲链表
+// 同级的下一次分配直接取用，协程模式下整条流水线在同一线程中，
+// 最后一个工位释放的码由第一个工位重新分配，不再访问全局堆
+// 线程模式下释放和分配不在同一线程，由流水线持有的Channel把块交还分配的线程
+// 每级最多缓存max_cached块，超出的块和大于最大级的块直接交给全局堆
+class Recycler {
+public:
+  static constexpr size_t min_size = 16;
+  static constexpr size_t classes = 5; // 16、32、64、128、256字节
+  static constexpr size_t max_cached = 4096;
+
+  // 跨线程归还块的通道，每级一个单生产者单消费者队列
+  // 队列已满时块按原路径回收到释放的线程
+  class Channel {
+  public:
+    static constexpr size_t slots = 1024;
+
+    Channel() = default;
+    Channel(const Channel &) = delete;
+    Channel &operator=(const Channel &) = delete;
+
+    // 两端的线程都已结束，剩余的块交给全局堆
+    ~Channel() {
+      void *block = nullptr;
+      for (auto &ring : _rings) {
+        while (ring.Read(block))
+          ::operator delete(block);
+      }
+    }
+
+  private:
+    friend class Recycler;
+    std::array<RingBuffer<void *, slots>, classes> _rings;
+  };
+
+  // 在当前线程中从source取回块、向sink归还块，析构时恢复
+  class Scope {
+  public:
+    Scope(Channel *source, Channel *sink)
+        : _prev_source(std::exchange(_source, source)),
+          _prev_sink(std::exchange(_sink, sink)) {}
+
+    ~Scope() {
+      _source = _prev_source;
+      _sink = _prev_sink;
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Channel *_prev_source;
+    Channel *_prev_sink;
+  };
+
+  static void *Allocate(size_t size) {
+    auto index = _Class(size);
+    if (index < classes) {
+      if (auto cache = _Local()) {
+        if (auto block = cache->heads[index]) {
+          cache->heads[index] = block->next;
+          --cache->counts[index];
+          return block;
+        }
+      }
+
+      if (void *block = nullptr;
+          _source && _source->_rings[index].Read(block))
+        return block;
+    }
+
+    _heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(index < classes ? _Size(index) : size);
+  }
+
+  static void Deallocate(void *ptr, size_t size) {
+    if (!ptr)
+      return;
+
+    auto index = _Class(size);
+    if (index < classes && _sink && _sink->_rings[index].Write(std::move(ptr)))
+      return;
+
+    if (auto cache = _Local();
+        cache && index < classes && cache->counts[index] < max_cached) {
+      cache->heads[index] = new (ptr) _Block{cache->heads[index]};
+      ++cache->counts[index];
+      return;
+    }
+
+    ::operator delete(ptr);
+  }
+
+  // 从全局堆分配的累计次数
+  static size_t HeapAllocations() {
+    return _heap_allocations.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct _Block {
+    _Block *next{nullptr};
+  };
+
+  struct _Cache {
+    _Cache() { _alive = true; }
+
+    ~_Cache() {
+      _alive = false;
+      for (auto head : heads) {
+        while (head)
+          ::operator delete(std::exchange(head, head->next));
+      }
+    }
+
+    std::array<_Block *, classes> heads{};
+    std::array<size_t, classes> counts{};
+  };
+
+  static size_t _Class(size_t size) {
+    return size <= min_size ? 0 : std::bit_width((size - 1) / min_size);
+  }
+
+  static size_t _Size(size_t index) { return min_size << index; }
+
+  // 线程退出时缓存已析构，之后的分配和释放直接使用全局堆
+  static _Cache *_Local() {
+    thread_local _Cache cache;
+    return _alive ? &cache : nullptr;
+  }
+
+private:
+  static inline thread_local bool _alive{false};
+  static inline thread_local Channel *_source{nullptr};
+  static inline thread_local Channel *_sink{nullptr};
+  static inline std::atomic<size_t> _heap_allocations{0};
+};
+
+// 用Recycler分配的类，按实际类型的大小回收，基类须有虚析构函数
+struct Recyclable {
+  static void *operator new(size_t size) { return Recycler::Allocate(size); }
+
+  static void operator delete(void *ptr, size_t size) {
+    Recycler::Deallocate(ptr, size);
+  }
+};
+} // namespace byfxxm
+
+#endif
@@ -1,23 +1,99 @@
 ﻿#ifndef _BYFXXM_RING_BUFFER_HPP_
 #define _BYFXXM_RING_BUFFER_HPP_
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <memory>
+#include <span>
 
 namespace byfxxm {
-template <class Ty, size_t Num>
+inline constexpr size_t cache_line_size = 64;
+
+// 槽数，固定槽数时为空基类，不占空间，Size直接返回Num
+template <size_t Num> struct _RingSize {
+  static constexpr size_t Size() { return Num; }
+};
+
+template <> struct _RingSize<std::dynamic_extent> {
+  size_t Size() const { return _size; }
+
+  size_t _size{1};
+};
+
+// 单生产者单消费者环形队列，最多存放Num - 1个元素
+// Write、WriteBulk、IsFull只在生产者一侧调用
+// Read、ReadBulk、IsEmpty、Clear只在消费者一侧调用
+// 两端的下标各占一个缓存行，并各自缓存对端的下标，缓存的值不够用时才读取对端
+// Num为std::dynamic_extent时，槽数在构造时指定，可用Resize改变
+template <class Ty, size_t Num = std::dynamic_extent>
   requires(Num > 0)
-class RingBuffer {
+class RingBuffer : private _RingSize<Num> {
+  using _Base = _RingSize<Num>;
+
 public:
-  bool IsEmpty() const { return _read_index == _write_index; }
+  static constexpr bool dynamic = Num == std::dynamic_extent;
+
+  RingBuffer()
+    requires(!dynamic)
+  = default;
+
+  explicit RingBuffer(size_t size)
+    requires(dynamic)
+      : _Base{std::max<size_t>(size, 1)},
+        _data(std::make_unique<Ty[]>(Size())) {}
+
+  // 槽数，最多存放Size() - 1个元素
+  using _Base::Size;
 
-  bool IsFull() const { return _Mod(_write_index + 1) == _read_index; }
+  // 改变槽数并保留已有元素，槽数不小于已有元素个数加1
+  // 两端都不在读写时才能调用，例如同一线程中的协程之间
+  void Resize(size_t size)
+    requires(dynamic)
+  {
+    auto read = _read_index.load(std::memory_order_relaxed);
+    auto count = _Mod(_write_index.load(std::memory_order_relaxed) + Size() -
+                      read);
+    size = std::max(size, count + 1);
+    auto data = std::make_unique<Ty[]>(size);
+    for (size_t i = 0; i < count; ++i) {
+      data[i] = std::move(_data[read]);
+      read = _Mod(read + 1);
+    }
+
+    _data = std::move(data);
+    this->_size = size;
+    _read_index.store(0, std::memory_order_relaxed);
+    _write_index.store(count, std::memory_order_relaxed);
+    _read_cache = 0;
+    _write_cache = count;
+  }
+
+  bool IsEmpty() const {
+    auto read = _read_index.load(std::memory_order_relaxed);
+    if (read != _write_cache)
+      return false;
+
+    _write_cache = _write_index.load(std::memory_order_acquire);
+    return read == _write_cache;
+  }
+
+  bool IsFull() const {
+    auto next = _Mod(_write_index.load(std::memory_order_relaxed) + 1);
+    if (next != _read_cache)
+      return false;
+
+    _read_cache = _read_index.load(std::memory_order_acquire);
+    return next == _read_cache;
+  }
 
   bool Write(Ty &&t) {
     if (IsFull())
       return false;
 
-    _data[_write_index] = std::move(t);
-    _write_index = _Mod(_write_index + 1);
+    auto write = _write_index.load(std::memory_order_relaxed);
+    _data[write] = std::move(t);
+    _write_index.store(_Mod(write + 1), std::memory_order_release);
     return true;
   }
 
@@ -25,11 +101,54 @@ public:
     if (IsEmpty())
       return false;
 
-    t = std::move(_data[_read_index]);
-    _read_index = _Mod(_read_index + 1);
+    auto read = _read_index.load(std::memory_order_relaxed);
+    t = std::move(_data[read]);
+    _read_index.store(_Mod(read + 1), std::memory_order_release);
     return true;
   }
 
+  // 依次移入items中的元素直到写满，返回写入的个数，只发布一次下标
+  size_t WriteBulk(std::span<Ty> items) {
+    auto write = _write_index.load(std::memory_order_relaxed);
+    auto room = _Distance(write, _read_cache);
+    if (room < items.size()) {
+      _read_cache = _read_index.load(std::memory_order_acquire);
+      room = _Distance(write, _read_cache);
+    }
+
+    auto count = std::min(room, items.size());
+    for (size_t i = 0; i < count; ++i) {
+      _data[write] = std::move(items[i]);
+      write = _Mod(write + 1);
+    }
+
+    if (count > 0)
+      _write_index.store(write, std::memory_order_release);
+
+    return count;
+  }
+
+  // 依次读出到items中直到读空，返回读出的个数，只发布一次下标
+  size_t ReadBulk(std::span<Ty> items) {
+    auto read = _read_index.load(std::memory_order_relaxed);
+    auto ready = _Mod(_write_cache + Size() - read);
+    if (ready < items.size()) {
+      _write_cache = _write_index.load(std::memory_order_acquire);
+      ready = _Mod(_write_cache + Size() - read);
+    }
+
+    auto count = std::min(ready, items.size());
+    for (size_t i = 0; i < count; ++i) {
+      items[i] = std::move(_data[read]);
+      read = _Mod(read + 1);
+    }
+
+    if (count > 0)
+      _read_index.store(read, std::memory_order_release);
+
+    return count;
+  }
+
   void Clear() {
     Ty temp;
     while (Read(temp)) {
@@ -37,17 +156,30 @@ public:
   }
 
 private:
-  static size_t _Mod(size_t num) {
-    if constexpr ((Num & (Num - 1)) == 0)
+  // num总小于两倍槽数，不必做除法
+  size_t _Mod(size_t num) const {
+    if constexpr (!dynamic && (Num & (Num - 1)) == 0)
       return (num & (Num - 1));
     else
-      return (num % Num);
+      return num >= Size() ? num - Size() : num;
+  }
+
+  // 从write到read之前还能写入的个数
+  size_t _Distance(size_t write, size_t read) const {
+    return _Mod(read + Size() - write - 1);
   }
 
 private:
-  std::atomic<size_t> _read_index{0};
-  std::atomic<size_t> _write_index{0};
-  Ty _data[Num];
+  // 生产者一侧
+  alignas(cache_line_size) std::atomic<size_t> _write_index{0};
+  mutable size_t _read_cache{0};
+  // 消费者一侧
+  alignas(cache_line_size) std::atomic<size_t> _read_index{0};
+  mutable size_t _write_cache{0};
+  // 两端只读
+  alignas(cache_line_size)
+      std::conditional_t<dynamic, std::unique_ptr<Ty[]>,
+                         std::array<Ty, dynamic ? 1 : Num>> _data;
 };
 } // namespace byfxxm
 
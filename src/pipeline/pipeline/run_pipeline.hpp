@@ -0,0 +1,205 @@
+﻿#ifndef _BYFXXM_RUN_PIPELINE_HPP_
+#define _BYFXXM_RUN_PIPELINE_HPP_
+
+#include "parker.hpp"
+#include "ring_buffer.hpp"
+#include "worker.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace byfxxm {
+template <class C> using BasicFifo = RingBuffer<C>;
+inline constexpr size_t default_fifo_capacity = 3;
+// 工位一次从上游读取的最多码数
+inline constexpr size_t batch_size = 64;
+
+template <class C> struct BasicStation {
+  std::unique_ptr<BasicBatchWorker<C>> worker;
+  std::unique_ptr<BasicFifo<C>> next;
+  BasicFifo<C> *prev = nullptr;
+  std::atomic<bool> done = false;
+  Parker readable; // 线程模式下等待next非空
+  Parker writable; // 线程模式下等待next不满
+  // 协程模式下next的阻塞统计
+  size_t full_stalls{0};  // 写入时已满的次数
+  size_t empty_stalls{0}; // 读取时为空的次数
+  size_t drained{0};      // 自上次读空以来取走的码数
+
+  size_t Capacity() const { return next->Size() - 1; }
+};
+
+struct PipelineException : public std::exception {
+public:
+  PipelineException() = default;
+  PipelineException(std::string err) : _error(std::move(err)) {}
+
+private:
+  std::string _error;
+};
+
+// 只在调用者线程中执行的流水线，不依赖协程和线程，见Run
+// BasicPipeline在此基础上增加协程和线程模式
+// C为工位之间传递的码，见BasicWorker
+template <class C> class BasicRunPipeline {
+public:
+  using Fifo = BasicFifo<C>;
+  using Station = BasicStation<C>;
+  using Codes = BasicCodes<C>;
+  using WriteBatchFunc = BasicWriteBatchFunc<C>;
+
+  // 在调用者线程中执行到结束，不使用协程、线程和Fifo
+  // 写出的码在本工位暂存，满一批或本工位的DoBatch返回时直接调用下游的DoBatch
+  // 下游处理完才返回，深度优先，不逐个下传是为了避免调用栈过深
+  // 各工位收到的码及其顺序与协程模式相同，返回false表示有工位出错或已停止
+  bool Run() {
+    if (_station_list.empty())
+      return true;
+
+    _stop = false;
+    for (auto &sta : _station_list)
+      sta->done = false;
+
+    std::vector<_Pending> pending(_station_list.size());
+    std::vector<WriteBatchFunc> writes(_station_list.size());
+    for (size_t i = 0; i + 1 < _station_list.size(); ++i) {
+      writes[i] = [this, i, &pending, &writes](Codes codes) {
+        if (_stop)
+          return;
+
+        auto &buf = pending[i];
+        auto end = _FindEnd(codes);
+        auto count = static_cast<size_t>(end - codes.begin());
+        if (buf.count == 0 && count >= batch_size) {
+          _Deliver(i, codes.first(count), pending, writes);
+        } else {
+          for (auto &code : codes.first(count)) {
+            buf.codes[buf.count++] = std::move(code);
+            if (buf.count == batch_size)
+              _Flush(i, pending, writes);
+          }
+        }
+
+        // 空码之后的码不再送给下游，与协程模式下读到结束标记相同
+        if (end != codes.end()) {
+          _Flush(i, pending, writes);
+          for (auto j = i + 1; j < _station_list.size(); ++j)
+            _station_list[j]->done = true;
+        }
+      };
+    }
+
+    // 最后一个工位没有下游，丢弃
+    writes.back() = [](Codes) {};
+    if (!_station_list.front()->worker->DoBatch({}, writes.front()))
+      Stop();
+
+    _Flush(0, pending, writes);
+    for (auto &sta : _station_list)
+      sta->done = true;
+
+    return !_stop;
+  }
+
+  // 可在其它线程中调用，各工位的DoBatch在Worker::Stop后尽快返回
+  void Stop() {
+    _stop = true;
+    for (auto &sta : _station_list) {
+      sta->worker->Stop();
+      sta->readable.Notify();
+      sta->writable.Notify();
+    }
+  }
+
+  // capacity为该工位输出的Fifo最多缓存的码数，Run时不使用Fifo
+  void AddWorker(std::unique_ptr<BasicBatchWorker<C>> worker,
+                 size_t capacity = default_fifo_capacity) {
+    if (!worker)
+      throw PipelineException("worker is null");
+
+    if (capacity == 0)
+      throw PipelineException("fifo capacity is zero");
+
+    auto station = std::make_unique<Station>();
+    station->worker = std::move(worker);
+    station->next = std::make_unique<Fifo>(capacity + 1);
+    _total_capacity += capacity;
+    if (!_station_list.empty())
+      station->prev = _station_list.back()->next.get();
+
+    _station_list.push_back(std::move(station));
+  }
+
+  // 逐个处理的Worker自动适配为BatchWorker
+  void AddWorker(std::unique_ptr<BasicWorker<C>> worker,
+                 size_t capacity = default_fifo_capacity) {
+    if (!worker)
+      throw PipelineException("worker is null");
+
+    AddWorker(std::make_unique<BasicWorkerBatcher<C>>(std::move(worker)),
+              capacity);
+  }
+
+  const Station &GetStation(size_t index) const {
+    return *_station_list.at(index);
+  }
+
+protected:
+  // 批次中的第一个空码，即上游写入的结束标记
+  static auto _FindEnd(Codes codes) {
+    return std::ranges::find_if(codes, [](auto &&code) { return !code; });
+  }
+
+  std::vector<std::unique_ptr<Station>> _station_list;
+  size_t _total_capacity{0};
+  std::atomic<bool> _stop = false;
+
+private:
+  // Run时各工位暂存的写出
+  struct _Pending {
+    std::array<C, batch_size> codes;
+    size_t count{0};
+  };
+
+  // 第i个工位写出的codes交给下游处理，之后下游暂存的码也依次交出
+  void _Deliver(size_t i, Codes codes, std::vector<_Pending> &pending,
+                const std::vector<WriteBatchFunc> &writes) {
+    auto &next = *_station_list[i + 1];
+    if (_stop || next.done)
+      return;
+
+    // 出错的工位此前写出的码仍交给下游，之后再停止
+    auto ok = next.worker->DoBatch(codes, writes[i + 1]);
+    if (i + 2 < _station_list.size())
+      _Flush(i + 1, pending, writes);
+
+    if (!ok)
+      Stop();
+  }
+
+  void _Flush(size_t i, std::vector<_Pending> &pending,
+              const std::vector<WriteBatchFunc> &writes) {
+    auto &buf = pending[i];
+    if (buf.count == 0)
+      return;
+
+    auto count = std::exchange(buf.count, 0);
+    _Deliver(i, Codes(buf.codes).first(count), pending, writes);
+  }
+};
+
+using Fifo = BasicFifo<std::unique_ptr<Code>>;
+using Station = BasicStation<std::unique_ptr<Code>>;
+using RunPipeline = BasicRunPipeline<std::unique_ptr<Code>>;
+
+// 工位之间按值传递CodeRecord，Fifo的槽位直接存放记录
+using RecordFifo = BasicFifo<CodeRecord>;
+using RecordStation = BasicStation<CodeRecord>;
+using RecordRunPipeline = BasicRunPipeline<CodeRecord>;
+} // namespace byfxxm
+
+#endif
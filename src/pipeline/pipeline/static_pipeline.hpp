@@ -0,0 +1,123 @@
+﻿#ifndef _BYFXXM_STATIC_PIPELINE_HPP_
+#define _BYFXXM_STATIC_PIPELINE_HPP_
+
+#include "worker.hpp"
+#include <atomic>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace byfxxm {
+// 静态流水线的工位，Input为从上游收到的码，Output为写出的码
+// 第一个工位的Input为void，最后一个工位的Output为void，依次实现：
+//   template <class Write> bool Do(Write &&write);
+//   template <class Write> bool Do(CodeArg<Input> code, Write &&write);
+//   bool Do(CodeArg<Input> code);
+// write只接受CodeArg<Output>，Do返回false表示出错
+template <class S>
+concept StageConcept = requires {
+  typename S::Input;
+  typename S::Output;
+};
+
+template <size_t I, class... Stages>
+using _StageAt = std::tuple_element_t<I, std::tuple<Stages...>>;
+
+// 第一个工位没有输入，最后一个工位没有输出，相邻工位的输出与输入类型相同
+template <class... Stages>
+inline constexpr bool stages_linked =
+    []<size_t... I>(std::index_sequence<I...>) {
+      constexpr auto last = sizeof...(Stages) - 1;
+      return std::is_void_v<typename _StageAt<0, Stages...>::Input> &&
+             std::is_void_v<typename _StageAt<last, Stages...>::Output> &&
+             (std::is_same_v<typename _StageAt<I, Stages...>::Output,
+                             typename _StageAt<I + 1, Stages...>::Input> &&
+              ...);
+    }(std::make_index_sequence<sizeof...(Stages) - 1>());
+
+// 工位在编译期确定的流水线，工位之间直接调用，不经过虚函数和std::function
+template <StageConcept... Stages>
+  requires(sizeof...(Stages) > 1 && stages_linked<Stages...>)
+class StaticPipeline {
+public:
+  StaticPipeline() = default;
+  explicit StaticPipeline(Stages... stages) : _stages(std::move(stages)...) {}
+
+  template <size_t I> auto &Get() { return std::get<I>(_stages); }
+
+  template <size_t I> const auto &Get() const { return std::get<I>(_stages); }
+
+  // 在调用者线程中执行到结束，每写出一个码就由下一个工位处理完再返回
+  // 工位之间没有队列，整条流水线内联为第一个工位中的一个循环
+  // 返回false表示有工位出错，出错后的写出全部丢弃
+  bool Run() {
+    _stop = false;
+    if (!std::get<0>(_stages).Do(_Write<0>{this}))
+      _stop = true;
+
+    return !_stop;
+  }
+
+  // 可在其它线程中调用，之后的写出全部丢弃
+  void Stop() { _stop = true; }
+
+private:
+  // 第I个工位的write，调用第I + 1个工位
+  template <size_t I> struct _Write {
+    using Out = typename _StageAt<I, Stages...>::Output;
+
+    void operator()(CodeArg<Out> code) const {
+      if (self->_stop.load(std::memory_order_relaxed))
+        return;
+
+      auto &next = std::get<I + 1>(self->_stages);
+      bool ok = false;
+      if constexpr (I + 2 == sizeof...(Stages))
+        ok = next.Do(std::move(code));
+      else
+        ok = next.Do(std::move(code), _Write<I + 1>{self});
+
+      if (!ok)
+        self->_stop = true;
+    }
+
+    StaticPipeline *self{nullptr};
+  };
+
+private:
+  std::tuple<Stages...> _stages;
+  std::atomic<bool> _stop = false;
+};
+
+// 把静态流水线的工位用作BasicPipeline<C>的Worker，可以按协程或线程模式执行
+// Input、Output须为C或void
+template <StageConcept S,
+          class C = std::conditional_t<std::is_void_v<typename S::Output>,
+                                       typename S::Input, typename S::Output>>
+class StageWorker : public BasicWorker<C> {
+public:
+  static_assert(std::is_void_v<typename S::Input> ||
+                std::is_same_v<typename S::Input, C>);
+  static_assert(std::is_void_v<typename S::Output> ||
+                std::is_same_v<typename S::Output, C>);
+
+  template <class... Args>
+  explicit StageWorker(Args &&...args) : _stage(std::forward<Args>(args)...) {}
+
+  S &Stage() { return _stage; }
+
+  bool Do(CodeArg<C> code, const BasicWriteFunc<C> &write) noexcept override {
+    if constexpr (std::is_void_v<typename S::Input>)
+      return _stage.Do(write);
+    else if constexpr (std::is_void_v<typename S::Output>)
+      return _stage.Do(std::move(code));
+    else
+      return _stage.Do(std::move(code), write);
+  }
+
+private:
+  S _stage;
+};
+} // namespace byfxxm
+
+#endif
@@ -1,18 +1,87 @@
 ﻿#ifndef _BYFXXM_WORKER_HPP_
 #define _BYFXXM_WORKER_HPP_
 
+#include "code.hpp"
 #include <functional>
 #include <memory>
+#include <span>
+#include <type_traits>
 
 namespace byfxxm {
-struct Code;
-using WriteFunc = std::function<void(std::unique_ptr<Code>)>;
+// C为工位之间传递的码，std::unique_ptr<Code>或按值传递的CodeRecord
+// 值为空表示没有码，第一个工位收到空码，流水线用空码作结束标记
+// 可平凡复制的码按常量引用传给Do和WriteFunc，只在写入Fifo时复制
+template <class C>
+using CodeArg =
+    std::conditional_t<std::is_trivially_copyable_v<C>, const C &, C>;
+template <class C> using BasicWriteFunc = std::function<void(CodeArg<C>)>;
+template <class C> using BasicCodes = std::span<C>;
+// 依次移走codes中的码
+template <class C>
+using BasicWriteBatchFunc = std::function<void(BasicCodes<C>)>;
 
-class Worker {
+// 流水线停止时调用Stop，可能与Do在不同线程中同时执行
+// 不会自行结束的Worker，如解析无限循环的程序，须在Stop后让Do尽快返回
+template <class C> class BasicWorker {
 public:
-  virtual ~Worker() = default;
-  virtual bool Do(std::unique_ptr<Code>, const WriteFunc &) noexcept = 0;
+  virtual ~BasicWorker() = default;
+  virtual bool Do(CodeArg<C>, const BasicWriteFunc<C> &) noexcept = 0;
+  virtual void Stop() noexcept {}
 };
+
+// 一次处理上游送来的一批码，可以多次调用write，每次写出一批
+// 第一个工位只调用一次，codes为空
+template <class C> class BasicBatchWorker {
+public:
+  virtual ~BasicBatchWorker() = default;
+  virtual bool DoBatch(BasicCodes<C> codes,
+                       const BasicWriteBatchFunc<C> &write) noexcept = 0;
+  // 同BasicWorker::Stop
+  virtual void Stop() noexcept {}
+};
+
+// 把逐个处理的Worker适配为BatchWorker，每个码仍单独写出，不改变反压
+template <class C> class BasicWorkerBatcher : public BasicBatchWorker<C> {
+public:
+  explicit BasicWorkerBatcher(std::unique_ptr<BasicWorker<C>> worker)
+      : _worker(std::move(worker)) {}
+
+  bool DoBatch(BasicCodes<C> codes,
+               const BasicWriteBatchFunc<C> &write) noexcept override {
+    const BasicWriteFunc<C> write_one = [&write](CodeArg<C> arg) {
+      C code = std::move(arg);
+      write(BasicCodes<C>(&code, 1));
+    };
+
+    if (codes.empty())
+      return _worker->Do(C{}, write_one);
+
+    for (auto &code : codes) {
+      if (!_worker->Do(std::move(code), write_one))
+        return false;
+    }
+
+    return true;
+  }
+
+  void Stop() noexcept override { _worker->Stop(); }
+
+private:
+  std::unique_ptr<BasicWorker<C>> _worker;
+};
+
+using WriteFunc = BasicWriteFunc<std::unique_ptr<Code>>;
+using Codes = BasicCodes<std::unique_ptr<Code>>;
+using WriteBatchFunc = BasicWriteBatchFunc<std::unique_ptr<Code>>;
+using Worker = BasicWorker<std::unique_ptr<Code>>;
+using BatchWorker = BasicBatchWorker<std::unique_ptr<Code>>;
+using WorkerBatcher = BasicWorkerBatcher<std::unique_ptr<Code>>;
+
+using RecordWriteFunc = BasicWriteFunc<CodeRecord>;
+using Records = BasicCodes<CodeRecord>;
+using RecordWriteBatchFunc = BasicWriteBatchFunc<CodeRecord>;
+using RecordWorker = BasicWorker<CodeRecord>;
+using RecordBatchWorker = BasicBatchWorker<CodeRecord>;
 } // namespace byfxxm
 
 #endif
@@ -0,0 +1,10 @@
+
+		#1 = 2
+		#2 = [#1 + 3] * 4 - -#1 / 2
+		#3 = 0
+		WHILE [#3 LT 5] DO
+			#3 = #3 + 1
+		END
+		IF NOT [#2 LT 10] THEN
+			#4 = #[#1 - 1] + MAX[#2, #3]
+		ENDIF
@@ -0,0 +1,6 @@
+
+		#1 = 1
+		WHILE [#1 LT 0] DO
+			#2 = NOT #1
+		END
+		#3 = 3
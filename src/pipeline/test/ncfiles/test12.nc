@@ -0,0 +1,8 @@
+#1 = 1
+#2 = NOT #1
+G1 X10 Y@
+IF #1 LT 2
+#3 = 3
+ENDIF
+#4 = [1 + 2
+G0 X#1
@@ -0,0 +1,10 @@
+#1 = 0
+#2 = 0
+G0 X#1
+WHILE [#1 LT 10] DO
+	#1 = #1 + 1
+END
+#2 = #1 * 2
+G1 X#2
+#3 = #2 + 1
+G1 X#3
@@ -0,0 +1,7 @@
+#1 = 0
+N1
+#1 = #1 + 1
+IF [#1 LT 5] THEN
+	GOTO 1
+ENDIF
+G1 X#1
@@ -0,0 +1,5 @@
+#1 = #5000
+#2 = #1 + 1
+G1 X#2
+#3 = 7
+#5001 = #3
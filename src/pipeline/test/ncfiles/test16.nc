@@ -0,0 +1,5 @@
+#1 = 10
+M98 P100 L3
+G65 P200 X2 Y3
+#4 = #1
+M98 P300 L2
@@ -0,0 +1,7 @@
+O300
+#100 = 0
+WHILE [#100 LT 2] DO
+	G1 X#100
+	#100 = #100 + 1
+END
+M99
@@ -0,0 +1,7 @@
+G0 X0 Y0 Z10
+G99 G81 X10 Y10 Z-5 R2
+X20
+Y20 Z-8
+G98 G83 X30 Q4 Z-10 R1
+G80
+G0 X0
@@ -0,0 +1,9 @@
+%
+(SETUP: vise)
+#1 = 2 (start)
+G0 X[#1 * 3] (rapid)
+WHILE [#1 LT 4] DO
+  #1 = #1 + 1 (step)
+  G1 X#1
+END
+%
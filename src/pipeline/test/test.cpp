@@ -2,14 +2,21 @@
 //
 #include "../pipeline/code.hpp"
 #include "../pipeline/gparser/gparser.hpp"
+#include "../pipeline/gparser/parser_pool.hpp"
+#include "../pipeline/gparser/static_stream.hpp"
 #include "../pipeline/gworker.hpp"
 #include "../pipeline/pipeline.hpp"
+#include "../pipeline/static_pipeline.hpp"
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <span>
+#include <sstream>
 #include <thread>
 #include <utility>
 
@@ -46,6 +53,7 @@ public:
     puts(std::format("N{}", utils.value).c_str());
     // utils.mark_snapshot(utils.value);
   }
+  virtual void Cycle(const Utils &) override {}
 };
 
 void TestParser() {
@@ -229,6 +237,894 @@ void TestParser9() {
     puts(res.value().c_str());
 }
 
+void TestParser10() {
+  auto parser = byfxxm::Gparser(std::ifstream(
+      std::filesystem::current_path().string() + "/ncfiles/test10.nc"));
+  auto gimpl = Gimpl();
+  byfxxm::Address addr;
+  if (auto res = parser.Run(&addr, &gimpl)) {
+    PrintLine(res.value());
+    return;
+  }
+
+  assert(addr[2] == 21);
+  assert(addr[3] == 5);
+  assert(addr[4] == 23);
+}
+
+void TestParser11() {
+  auto parser = byfxxm::Gparser(std::ifstream(
+      std::filesystem::current_path().string() + "/ncfiles/test11.nc"));
+  auto gimpl = Gimpl();
+  byfxxm::Address addr;
+  auto res = parser.Run(&addr, &gimpl);
+  assert(res);
+  puts(res.value().c_str());
+  assert(addr[1] == 1);
+  assert(byfxxm::IsNaN(addr[3]));
+}
+
+void TestParser12() {
+  auto parser = byfxxm::Gparser(std::ifstream(
+      std::filesystem::current_path().string() + "/ncfiles/test12.nc"));
+  auto diags = parser.Validate();
+  for (auto &diag : diags)
+    PrintLine(std::format("line {}, column {}: {}", diag.line, diag.column,
+                          diag.error));
+
+  constexpr size_t lines[] = {2, 3, 4, 6, 7};
+  assert(diags.size() == std::size(lines));
+  for (size_t i = 0; i < diags.size(); ++i)
+    assert(diags[i].line == lines[i]);
+
+  assert(diags[0].code == byfxxm::errc::TYPE);
+  assert(diags[1].code == byfxxm::errc::LEX);
+  assert(diags[2].code == byfxxm::errc::SYNTAX);
+
+  // 每个错误都带有出错原因
+  constexpr std::string_view errors[] = {"\"NOT\" error", "unknown character",
+                                         "missing THEN", "unexpected word",
+                                         "unbalanced bracket"};
+  for (size_t i = 0; i < diags.size(); ++i)
+    assert(diags[i].error == errors[i]);
+
+  // 不完整的G代码、空括号、表达式中的关键字、超出范围的数
+  auto source = "G0 X Y1\n#1 = []\n#2 = 1 THEN\nX" + std::string(400, '9') +
+                "\nG0 X1\n";
+  auto more = byfxxm::Gparser(std::stringstream(source)).Validate();
+  constexpr byfxxm::errc codes[] = {byfxxm::errc::SYNTAX, byfxxm::errc::SYNTAX,
+                                    byfxxm::errc::SYNTAX, byfxxm::errc::LEX};
+  assert(more.size() == std::size(codes));
+  constexpr std::string_view reasons[] = {"missing value", "empty bracket",
+                                          "unexpected word",
+                                          "malformed number"};
+  for (size_t i = 0; i < more.size(); ++i) {
+    assert(more[i].line == i + 1);
+    assert(more[i].code == codes[i]);
+    assert(more[i].error == reasons[i]);
+  }
+}
+
+class MotionGimpl : public Gimpl {
+public:
+  virtual void G0(const Utils &utils) override { _Record(utils); }
+  virtual void G1(const Utils &utils) override { _Record(utils); }
+
+  std::vector<double> xs;
+
+private:
+  void _Record(const Utils &utils) {
+    if (utils.params.Has(byfxxm::token::Kind::X))
+      xs.push_back(utils.params[byfxxm::token::Kind::X]);
+  }
+};
+
+class LabelGimpl : public MotionGimpl {
+public:
+  virtual void N(const Utils &utils) override {
+    utils.mark_snapshot(utils.value);
+  }
+};
+
+void TestParser13() {
+  auto path = std::filesystem::current_path().string() + "/ncfiles/test13.nc";
+  byfxxm::Checkpoints checkpoints(3);
+  {
+    auto parser = byfxxm::Gparser(std::ifstream(path));
+    auto gimpl = MotionGimpl();
+    byfxxm::Address addr;
+    parser.SetCheckpoints(&checkpoints);
+    if (auto res = parser.Run(&addr, &gimpl)) {
+      PrintLine(res.value());
+      return;
+    }
+
+    assert(gimpl.xs == std::vector<double>({0, 20, 21}));
+    assert(checkpoints.Size() == 6);
+  }
+
+  auto run_from = [&](size_t line) {
+    auto parser = byfxxm::Gparser(std::ifstream(path));
+    auto gimpl = MotionGimpl();
+    byfxxm::Address addr;
+    if (auto res = parser.RunFrom(&addr, &gimpl, checkpoints, line))
+      PrintLine(res.value());
+
+    assert(addr[1] == 10);
+    assert(addr[3] == 21);
+    return gimpl.xs;
+  };
+
+  assert(run_from(10) == std::vector<double>({21}));
+  assert(run_from(8) == std::vector<double>({20, 21}));
+  assert(run_from(1) == std::vector<double>({0, 20, 21}));
+
+  // WHILE每轮开始处也记录检查点，循环之后的行从最后一轮开始处恢复
+  {
+    byfxxm::Address addr;
+    auto cp = checkpoints.Restore(7, &addr);
+    assert(cp && cp->snapshot.line == 4 && addr[1] == 9);
+  }
+
+  // 二进制模式读入的CRLF，GOTO和检查点按实际字节数定位
+  constexpr auto crlf = "#1 = 0\r\nN1\r\n#1 = #1 + 1\r\nIF [#1 LT 3] THEN\r\n"
+                        "  GOTO 1\r\nENDIF\r\nG1 X#1\r\n#2 = #1 * 2\r\n"
+                        "G1 X#2\r\n";
+  byfxxm::Checkpoints every(1);
+  {
+    auto parser = byfxxm::Gparser(std::stringstream(crlf));
+    auto gimpl = LabelGimpl();
+    byfxxm::Address addr;
+    parser.SetCheckpoints(&every);
+    auto res = parser.Run(&addr, &gimpl);
+    assert(!res && gimpl.xs == std::vector<double>({3, 6}));
+  }
+
+  auto parser = byfxxm::Gparser(std::stringstream(crlf));
+  auto gimpl = LabelGimpl();
+  byfxxm::Address addr;
+  auto res = parser.RunFrom(&addr, &gimpl, every, 9);
+  assert(!res && gimpl.xs == std::vector<double>({6}));
+}
+
+// 调试版本定义了BYFXXM_GPARSER_STATS，见makefile和test.vcxproj
+void TestParser14() {
+  auto parser = byfxxm::Gparser(std::ifstream(
+      std::filesystem::current_path().string() + "/ncfiles/test10.nc"));
+  byfxxm::Address addr;
+  if (auto res = parser.Run(&addr, nullptr)) {
+    PrintLine(res.value());
+    return;
+  }
+
+  auto &stats = parser.GetStats();
+#ifdef BYFXXM_GPARSER_STATS
+  PrintLine(std::format("tokens {}, statements {}, nodes {}, lookups {}, "
+                        "inserts {}, gotos {}, iterations {}",
+                        stats.tokens, stats.statements, stats.nodes,
+                        stats.lookups, stats.inserts, stats.gotos,
+                        stats.iterations));
+  PrintLine(std::format("lexer {}, syntax {}, abstree {}, ginterface {}",
+                        stats.lexer, stats.syntax, stats.abstree,
+                        stats.ginterface));
+  assert(stats.statements == 7);
+  assert(stats.iterations == 5);
+  assert(stats.gotos == 0);
+  assert(stats.inserts == 4);
+  assert(stats.lexer > 0 && stats.syntax >= stats.lexer);
+#else
+  // 不采集时埋点为空，统计全为0
+  assert(stats.tokens == 0 && stats.statements == 0 && stats.lexer == 0);
+#endif
+}
+
+void TestParser15() {
+  auto path = std::filesystem::current_path().string() + "/ncfiles/test10.nc";
+  auto profile = [&](size_t interval) {
+    auto parser = byfxxm::Gparser(std::ifstream(path));
+    byfxxm::Profiler profiler(interval);
+    byfxxm::Address addr;
+    parser.SetProfiler(&profiler);
+    if (auto res = parser.Run(&addr, nullptr))
+      PrintLine(res.value());
+
+    return profiler;
+  };
+
+  auto profiler = profile(1);
+  std::ostringstream report;
+  profiler.Report(report);
+  PrintLine(report.str());
+
+  auto entries = profiler.Entries();
+  auto count = [&](size_t line) {
+    auto iter =
+        std::ranges::find(entries, line, &byfxxm::Profiler::Entry::line);
+    return iter == entries.end() ? 0 : iter->count;
+  };
+  assert(entries.size() == 7);
+  assert(count(2) == 1);
+  assert(count(5) == 6);
+  assert(count(6) == 5);
+  assert(count(9) == 1);
+
+  std::ostringstream folded;
+  profiler.Folded(folded);
+  PrintLine(folded.str());
+  assert(folded.str().find("main;L5;L6 ") != std::string::npos);
+
+  // 采样只影响耗时，次数不变
+  assert(profile(4).Entries().size() == entries.size());
+}
+
+void TestParser16() {
+  auto parser = byfxxm::Gparser(std::ifstream(
+      std::filesystem::current_path().string() + "/ncfiles/test13.nc"));
+  byfxxm::Address addr;
+  std::string error;
+  auto next = [&]() {
+    auto block = parser.NextBlock(&addr, &error);
+    assert(error.empty());
+    return block;
+  };
+
+  // 只解析到第一个段，循环还未执行
+  auto block = next();
+  assert(block && block->func == &byfxxm::Ginterface::G0);
+  assert(block->snapshot.line == 3);
+  assert(block->params.Size() == 1);
+  assert(block->params[byfxxm::token::Kind::X] == 0);
+  assert(addr[1] == 0);
+
+  block = next();
+  assert(block && block->func == &byfxxm::Ginterface::G1);
+  assert(block->snapshot.line == 8);
+  assert(block->params[byfxxm::token::Kind::X] == 20);
+  assert(addr[1] == 10);
+
+  block = next();
+  assert(block && block->params[byfxxm::token::Kind::X] == 21);
+  assert(!next());
+}
+
+// 登记N标号，GOTO才能跳转
+void TestParser17() {
+  auto run = [](const std::string &name, bool parallel,
+                MotionGimpl &&gimpl = MotionGimpl(),
+                byfxxm::Stats *stats = nullptr) {
+    auto parser = byfxxm::Gparser(std::ifstream(
+        std::filesystem::current_path().string() + "/ncfiles/" + name));
+    byfxxm::Address addr;
+    parser.SetParallel(parallel);
+    auto res = parser.Run(&addr, &gimpl);
+    if (stats)
+      *stats = parser.GetStats();
+
+    auto values = addr.Dump();
+    std::ranges::for_each(values, [](auto &&v) {
+      if (byfxxm::IsNaN(v.second))
+        v.second = 0;
+    });
+    std::ranges::sort(values);
+    return std::make_tuple(res, values, gimpl.xs);
+  };
+
+  [[maybe_unused]] size_t compared = 0;
+  for (int i = 0; i <= 13; ++i) {
+    auto name = i == 0 ? std::string("test.nc") : std::format("test{}.nc", i);
+    byfxxm::Stats serial;
+    byfxxm::Stats parallel;
+    auto res = run(name, false, MotionGimpl(), &serial);
+    assert(res == run(name, true, MotionGimpl(), &parallel));
+
+#ifdef BYFXXM_GPARSER_STATS
+    // 生产线程的统计并入Run的统计；有GOTO或出错时生产线程多解析的语句会丢弃
+    if (!std::get<0>(res) && serial.gotos == 0) {
+      assert(parallel.tokens == serial.tokens);
+      assert(parallel.statements == serial.statements);
+      assert(parallel.nodes == serial.nodes);
+      assert(parallel.lookups == serial.lookups);
+      ++compared;
+    }
+#endif
+  }
+
+#ifdef BYFXXM_GPARSER_STATS
+  assert(compared > 0);
+#endif
+
+  auto [res, values, xs] = run("test14.nc", true, LabelGimpl());
+  assert(!res);
+  assert(run("test14.nc", false, LabelGimpl()) ==
+         run("test14.nc", true, LabelGimpl()));
+  assert(xs == std::vector<double>({5}));
+}
+
+// 统计分配次数和未归还的字节数
+class CountingResource : public std::pmr::memory_resource {
+public:
+  size_t allocations{0};
+  size_t outstanding{0};
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    ++allocations;
+    outstanding += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    outstanding -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+void TestParser18() {
+  auto dir = std::filesystem::current_path().string() + "/ncfiles/";
+  std::vector<std::string> names;
+  for (int i = 2; i <= 13; ++i)
+    names.push_back(std::format("test{}.nc", i));
+
+  byfxxm::ParserPool pool(4);
+  std::vector<std::future<byfxxm::ParserPool::Result>> results;
+  std::vector<std::future<byfxxm::Diagnostics>> diags;
+  for (auto &name : names) {
+    results.push_back(pool.Run(std::ifstream(dir + name)));
+    diags.push_back(pool.Validate(std::ifstream(dir + name)));
+  }
+
+  for (size_t i = 0; i < names.size(); ++i) {
+    auto parser = byfxxm::Gparser(std::ifstream(dir + names[i]));
+    byfxxm::Address addr;
+    auto error = parser.Run(&addr, nullptr);
+    auto res = results[i].get();
+    assert(res.error == error);
+    assert(res.values.size() == addr.Dump().size());
+    assert(diags[i].get().size() ==
+           byfxxm::Gparser(std::ifstream(dir + names[i])).Validate().size());
+  }
+
+  // 作用域内的解析从指定的内存池分配，解析器销毁后全部归还
+  CountingResource counting;
+  {
+    byfxxm::MempoolScope scope(&counting);
+    auto parser = byfxxm::Gparser(std::ifstream(dir + "test13.nc"));
+    byfxxm::Address addr;
+    auto error = parser.Run(&addr, nullptr);
+    assert(!error);
+  }
+  assert(counting.allocations > 0 && counting.outstanding == 0);
+}
+
+// 编译期已知的指令处理类型，不继承Ginterface
+struct DirectGimpl {
+  using Utils = byfxxm::Ginterface::Utils;
+
+  void None(const Utils &) {}
+  void G0(const Utils &utils) { _Record(utils); }
+  void G1(const Utils &utils) { _Record(utils); }
+  void G2(const Utils &) {}
+  void G3(const Utils &) {}
+  void G4(const Utils &) {}
+  void N(const Utils &) {}
+  void Cycle(const Utils &) {}
+
+  std::vector<double> xs;
+
+private:
+  void _Record(const Utils &utils) {
+    if (utils.params.Has(byfxxm::token::Kind::X))
+      xs.push_back(utils.params[byfxxm::token::Kind::X]);
+  }
+};
+
+void TestParser19() {
+  auto path = std::filesystem::current_path().string() + "/ncfiles/test13.nc";
+  for (auto parallel : {false, true}) {
+    auto parser =
+        byfxxm::BasicGparser<std::ifstream, DirectGimpl>(std::ifstream(path));
+    DirectGimpl gimpl;
+    byfxxm::Address addr;
+    parser.SetParallel(parallel);
+    if (auto res = parser.Run(&addr, &gimpl)) {
+      PrintLine(res.value());
+      return;
+    }
+
+    assert(gimpl.xs == std::vector<double>({0, 20, 21}));
+    assert(addr[3] == 21);
+  }
+}
+
+// 记录G0收到的参数
+class ParamsGimpl : public Gimpl {
+public:
+  virtual void G0(const Utils &utils) override {
+    tags.assign(utils.params.begin(), utils.params.end());
+  }
+
+  std::vector<byfxxm::Gtag> tags;
+};
+
+void TestParser20() {
+  using byfxxm::token::Kind;
+  byfxxm::Gparams params;
+  assert(params.Empty());
+  params.Set({Kind::Y, 2});
+  params.Set({Kind::X, 1});
+  params.Set({Kind::F, 100});
+  params.Set({Kind::X, 3});
+
+  assert(params.Size() == 4);
+  assert(params.Has(Kind::X) && !params.Has(Kind::Z));
+  assert(params[Kind::X] == 3);
+  assert(params.Has(Kind::X, 1) && params.Has(Kind::X, 3));
+  assert(!params.Has(Kind::X, 2) && !params.Has(Kind::Z, 0));
+  assert(params.Get(Kind::Z, -1) == -1);
+  assert(params.Mask() == (byfxxm::Gparams::Bit(Kind::X) |
+                           byfxxm::Gparams::Bit(Kind::Y) |
+                           byfxxm::Gparams::Bit(Kind::F)));
+
+  // 按源码顺序保留重复的字母
+  std::vector<byfxxm::Gtag> tags(params.begin(), params.end());
+  assert(tags == std::vector<byfxxm::Gtag>({{Kind::Y, 2},
+                                            {Kind::X, 1},
+                                            {Kind::F, 100},
+                                            {Kind::X, 3}}));
+
+  // 超过inline_words个字时仍全部保留
+  byfxxm::Gparams many;
+  for (size_t i = 0; i < byfxxm::Gparams::inline_words + 4; ++i)
+    many.Set({Kind::M, static_cast<double>(i)});
+
+  assert(many.Size() == byfxxm::Gparams::inline_words + 4);
+  assert(many.Has(Kind::M, 0) && many.Has(Kind::M, 17));
+  assert(!many.Has(Kind::M, 20));
+  assert(many[Kind::M] == 19);
+
+  // 同一段中的多个M字都交给Ginterface
+  ParamsGimpl gimpl;
+  auto parser = byfxxm::Gparser(std::stringstream("G0 M3 X1 M8\n"));
+  byfxxm::Address addr;
+  auto res = parser.Run(&addr, &gimpl);
+  assert(!res);
+  assert(gimpl.tags == std::vector<byfxxm::Gtag>(
+                           {{Kind::M, 3}, {Kind::X, 1}, {Kind::M, 8}}));
+
+  auto end = byfxxm::GparamsToEnd(params);
+  assert(end[0] == 3 && end[1] == 2 && byfxxm::IsNaN(end[2]));
+}
+
+void TestParser21() {
+  auto dir = std::filesystem::current_path().string() + "/ncfiles/";
+  auto speculate = [&](const std::string &name, byfxxm::Address &addr,
+                       MotionGimpl &&gimpl, size_t depth) {
+    auto parser = byfxxm::Gparser(std::ifstream(dir + name));
+    if (auto res = parser.RunSpeculative(&addr, &gimpl, depth))
+      PrintLine(res.value());
+
+    return gimpl.xs;
+  };
+
+  // 没有GetSet变量时与顺序执行一致
+  for (size_t depth : {1, 2, 100}) {
+    byfxxm::Address addr;
+    assert(speculate("test13.nc", addr, MotionGimpl(), depth) ==
+           std::vector<double>({0, 20, 21}));
+    assert(addr[1] == 10 && addr[3] == 21);
+    assert(speculate("test14.nc", addr, LabelGimpl(), depth) ==
+           std::vector<double>({5}));
+  }
+
+  // 读过#5000之后机床值被更新，提交前发现变化，重新执行
+  double machine = 0;
+  double output = 0;
+  int reads = 0;
+  byfxxm::Address addr;
+  auto probe = [&]() {
+    ++reads;
+    return std::exchange(machine, 5);
+  };
+  addr.Insert(5000, byfxxm::SharpValue::GetSet{probe, [](double) {}});
+  addr.Insert(5001, byfxxm::SharpValue::GetSet{[&]() { return output; },
+                                               [&](double v) { output = v; }});
+  assert(speculate("test15.nc", addr, MotionGimpl(), 10) ==
+         std::vector<double>({6}));
+  assert(addr[1] == 5 && addr[2] == 6);
+  assert(output == 7);
+  assert(reads > 2);
+
+  // 每次读都变化，重试用完后逐条执行并提交，G指令用的是最后一次读到的值
+  auto counter = [](double &n) {
+    return byfxxm::SharpValue::GetSet{[&]() { return n++; }, [](double) {}};
+  };
+  auto run = [](const char *source, byfxxm::Address &addr, size_t depth) {
+    MotionGimpl gimpl;
+    auto parser = byfxxm::Gparser(std::stringstream(source));
+    auto res = parser.RunSpeculative(&addr, &gimpl, depth);
+    assert(!res);
+    return gimpl.xs;
+  };
+  double n = 0;
+  byfxxm::Address changing;
+  changing.Insert(5000, counter(n));
+  assert(run("#1 = #5000\nG1 X#1\n#2 = #5000\nG1 X#2\n", changing, 10) ==
+         std::vector<double>({8, 9}));
+  assert(changing[1] == 8 && changing[2] == 9 && n == 10);
+
+  // 同一行中;分隔的语句在同一个窗口中，重新执行时不会重复已提交的语句
+  machine = 0;
+  byfxxm::Address semi;
+  semi.Insert(5000, byfxxm::SharpValue::GetSet{probe, [](double) {}});
+  assert(run("#1 = 0\n#1 = #1 + 1; #2 = #5000; G1 X#1\n", semi, 1) ==
+         std::vector<double>({1}));
+  assert(semi[1] == 1 && semi[2] == 5);
+}
+
+void TestParser22() {
+  auto dir = std::filesystem::current_path().string() + "/ncfiles/";
+  byfxxm::Subprograms subprograms;
+  subprograms.Add(100, "O100\n#1 = #1 + 1\nG1 X#1\nM99\n");
+  subprograms.Add(200, R"(O200
+#1 = #24 * #25
+M98 P100
+IF #1 GT 5 THEN
+  M99
+ENDIF
+G1 X99
+)");
+  subprograms.AddFile(300, dir + "test17.nc");
+  subprograms.Add(400, "O400\nM98 P400\n");
+
+  auto run = [&](const std::string &source, MotionGimpl &gimpl,
+                 byfxxm::Address &addr) {
+    auto parser = byfxxm::Gparser(std::stringstream(source));
+    parser.SetSubprograms(&subprograms);
+    auto res = parser.Run(&addr, &gimpl);
+#ifdef BYFXXM_GPARSER_STATS
+    if (!res) {
+      assert(parser.GetStats().calls == 4);
+      assert(parser.GetStats().subprograms == 3);
+    }
+#endif
+    return res;
+  };
+
+  // M98共用调用者的局部变量，G65压入新的一层，M99提前返回
+  std::ifstream file(dir + "test16.nc");
+  std::string source((std::istreambuf_iterator<char>(file)), {});
+  MotionGimpl gimpl;
+  byfxxm::Address addr;
+  if (auto res = run(source, gimpl, addr)) {
+    PrintLine(res.value());
+    return;
+  }
+
+  assert(gimpl.xs == std::vector<double>({11, 12, 13, 7, 0, 1, 0, 1}));
+  assert(addr[1] == 13 && addr[4] == 13 && addr[100] == 2);
+  assert(byfxxm::IsNaN(addr[24]) && addr.Depth() == 0);
+
+  auto error = [&](const std::string &source) {
+    MotionGimpl unused;
+    return run(source, unused, addr).value_or("");
+  };
+  assert(error("M98 P500\n").find("subprogram not found") != std::string::npos);
+  assert(error("M98 P400\n").find("recursion") != std::string::npos);
+
+  // 子程序中的语句按调用处所在行计，检查点、UpdateSnapshot和Profiler都不受
+  // 子程序行号的影响
+  std::string body = "O1\n";
+  for (size_t i = 0; i < 47; ++i)
+    body += "#1 = #1 + 1\n";
+  body += "G1 X#1\nM99\n";
+  subprograms.Add(1, body);
+  constexpr auto caller = "#1 = 0\nG1 X1\n#2 = 0\nM98 P1\nG1 X2\n#3 = 1\n"
+                        "G1 X[#1 + 100]\nG1 X8\n";
+  byfxxm::Checkpoints every(1);
+  auto run_from = [&](size_t line, std::vector<size_t> &lines,
+                      byfxxm::Profiler *profiler = nullptr) {
+    auto parser = byfxxm::Gparser(std::stringstream(caller));
+    parser.SetSubprograms(&subprograms);
+    parser.SetCheckpoints(&every);
+    parser.SetProfiler(profiler);
+    MotionGimpl gimpl;
+    byfxxm::Address addr;
+    auto update = [&](const byfxxm::Snapshot &snapshot) {
+      lines.push_back(snapshot.line);
+    };
+    auto res = line ? parser.RunFrom(&addr, &gimpl, every, line, update)
+                    : parser.Run(&addr, &gimpl, update);
+    assert(!res && addr[1] == 47 && addr[3] == 1);
+    return gimpl.xs;
+  };
+
+  std::vector<size_t> lines;
+  byfxxm::Profiler profiler;
+  assert(run_from(0, lines, &profiler) ==
+         std::vector<double>({1, 47, 2, 147, 8}));
+  assert(lines == std::vector<size_t>({1, 2, 3, 4, 5, 6, 7, 8}));
+  assert(std::ranges::all_of(profiler.Entries(),
+                             [](auto &&entry) { return entry.line <= 8; }));
+
+  lines.clear();
+  assert(run_from(7, lines) == std::vector<double>({147, 8}));
+  assert(lines == std::vector<size_t>({7, 8}));
+}
+
+// 把Move/Line输出为G0/G1文本，省略不变的轴
+std::string FormatCode(const byfxxm::Code &code) {
+  auto &end = code.tag == byfxxm::codetag::MOVE
+                  ? static_cast<const byfxxm::Move &>(code).end
+                  : static_cast<const byfxxm::Line &>(code).end;
+  std::string ret = code.tag == byfxxm::codetag::MOVE ? "G0" : "G1";
+  for (size_t i = 0; i < 3; ++i) {
+    if (!byfxxm::IsNaN(end[i]))
+      ret += std::format(" {}{}", "XYZ"[i], end[i]);
+  }
+
+  return ret;
+}
+
+void TestParser23() {
+  std::vector<std::string> codes;
+  byfxxm::Gimpl gimpl([&](std::unique_ptr<byfxxm::Code> code) {
+    codes.push_back(FormatCode(*code));
+  });
+  auto parser = byfxxm::Gparser(std::ifstream(
+      std::filesystem::current_path().string() + "/ncfiles/test18.nc"));
+  byfxxm::Address addr;
+  if (auto res = parser.Run(&addr, &gimpl)) {
+    PrintLine(res.value());
+    return;
+  }
+
+  // G99返回R平面，后续只给孔位的段沿用G81；G83每次回退到R平面，最后返回初始平面
+  assert(codes == std::vector<std::string>({
+                      "G0 X0 Y0 Z10",
+                      "G0 X10 Y10", "G0 Z2", "G1 Z-5", "G0 Z2",
+                      "G0 X20", "G1 Z-5", "G0 Z2",
+                      "G0 Y20", "G1 Z-8", "G0 Z2",
+                      "G0 X30", "G0 Z1",
+                      "G1 Z-3", "G0 Z1",
+                      "G0 Z-2", "G1 Z-7", "G0 Z1",
+                      "G0 Z-6", "G1 Z-10", "G0 Z10",
+                      "G0 X0",
+                  }));
+}
+
+void TestParser24() {
+  constexpr byfxxm::FixedString loop = R"(#1 = 2
+G0 X[#1 * 3] Y-1
+WHILE [#1 LT 4] DO
+  #1 = #1 + 1
+  G1 X#1
+END
+)";
+  constexpr byfxxm::FixedString jump = R"(#1 = 0
+N1
+#1 = #1 + 1
+IF [#1 LT 5] THEN
+  GOTO 1
+ENDIF
+G1 X#1
+)";
+  using byfxxm::static_nc::nc_error;
+  static_assert(byfxxm::StaticStream<loop>::program.error == nc_error::none);
+
+  auto run = [](auto &&make_stream, MotionGimpl &&gimpl) {
+    assert(byfxxm::Gparser(make_stream()).Validate().empty());
+    auto parser = byfxxm::Gparser(make_stream());
+    byfxxm::Address addr;
+    auto res = parser.Run(&addr, &gimpl);
+    assert(!res);
+    return std::make_tuple(static_cast<double>(addr[1]), gimpl.xs);
+  };
+
+  // 编译期词法分析的结果与运行时扫描字符一致
+  auto static_loop =
+      run([] { return byfxxm::StaticStream<loop>(); }, MotionGimpl());
+  assert(static_loop ==
+         run([&] { return std::stringstream(loop.data); }, MotionGimpl()));
+  assert(std::get<1>(static_loop) == std::vector<double>({6, 3, 4}));
+  assert(run([] { return byfxxm::StaticStream<jump>(); }, LabelGimpl()) ==
+         run([&] { return std::stringstream(jump.data); }, LabelGimpl()));
+
+  // 出错的行号和原因在编译期给出
+  constexpr auto bracket = byfxxm::static_nc::compiled<"G1 X1\nG1 X[1\n">;
+  static_assert(bracket.error == nc_error::unbalanced_bracket &&
+                bracket.line == 2);
+  constexpr auto block = byfxxm::static_nc::compiled<"WHILE [1] DO\nG1\n">;
+  static_assert(block.error == nc_error::unclosed_block && block.line == 1);
+  static_assert(byfxxm::static_nc::compiled<"G1 X1.2.3">.error ==
+                nc_error::malformed_number);
+  static_assert(byfxxm::static_nc::compiled<"G1 X9007199254740993">.error ==
+                nc_error::inexact_number);
+  static_assert(byfxxm::static_nc::compiled<"G1 X0.00000000000000000000001">
+                    .error == nc_error::inexact_number);
+
+  // 数组按实际的单词和注释个数分配
+  constexpr auto &program = byfxxm::static_nc::compiled<"G1 X1 (a)\n">;
+  static_assert(program.tokens.size() == 6 && program.comments.size() == 1);
+
+  // 两种词法对同一段源码给出相同的单词和值
+  constexpr byfxxm::FixedString literals =
+      "X0.1 Y0.3 Z123.456 A-7. B+0.0000001 C2.50000000000000000000\n"
+      "I9007199254740992 J0.1234567890123456 K[-1]-2 F1.7976931348623 S0007\n";
+  auto scan = [](auto &&lex) {
+    std::vector<std::string> words;
+    for (;;) {
+      auto tok = lex.Get();
+      auto value = tok.value ? std::get<double>(tok.value.value()) : 0.0;
+      words.push_back(std::format("{} {}", static_cast<int>(tok.kind), value));
+      if (tok.kind == byfxxm::token::Kind::KEOF)
+        return words;
+    }
+  };
+  assert(scan(byfxxm::Lexer(byfxxm::StaticStream<literals>())) ==
+         scan(byfxxm::Lexer(std::stringstream(literals.data))));
+}
+
+void TestParser25() {
+  constexpr byfxxm::FixedString source = R"(%
+(SETUP: vise)
+#1 = 2 (start)
+G0 X[#1 * 3] (rapid)
+WHILE [#1 LT 4] DO
+  #1 = #1 + 1 (step)
+  G1 X#1
+END
+%
+)";
+  using Comments = std::vector<std::pair<std::string, size_t>>;
+  auto run = [](auto &&stream, bool parallel = false) {
+    Comments comments;
+    auto parser = byfxxm::Gparser(std::move(stream));
+    parser.SetParallel(parallel);
+    parser.SetOnComment([&](std::string_view text, size_t line) {
+      comments.emplace_back(text, line);
+    });
+    byfxxm::Address addr;
+    MotionGimpl gimpl;
+    auto res = parser.Run(&addr, &gimpl);
+    assert(!res);
+    return std::make_tuple(gimpl.xs, comments);
+  };
+
+  // 注释和%行不影响执行结果，循环体中的注释只在读入时回调一次
+  auto expected = std::make_tuple(std::vector<double>({6, 3, 4}),
+                                  Comments({{"SETUP: vise", 2},
+                                            {"start", 3},
+                                            {"rapid", 4},
+                                            {"step", 6}}));
+  assert(run(std::ifstream(std::filesystem::current_path().string() +
+                           "/ncfiles/test19.nc")) == expected);
+  assert(run(std::stringstream(source.data), true) == expected);
+  assert(run(byfxxm::StaticStream<source>()) == expected);
+
+  // 注释不能跨行
+  MotionGimpl gimpl;
+  byfxxm::Address addr;
+  assert(byfxxm::Gparser(std::stringstream("G1 X1 (feed\nG1 X2\n"))
+             .Run(&addr, &gimpl));
+  static_assert(byfxxm::static_nc::compiled<"G1 X1 (feed\nG1 X2\n">.error ==
+                byfxxm::static_nc::nc_error::unterminated_comment);
+
+  // 跨越文件读缓冲区的长注释拼接后完整回调
+  auto path = std::filesystem::temp_directory_path() / "byfxxm_comment.nc";
+  std::ofstream(path) << "G1 X1 (" << std::string(20000, 'a') << ")\nG1 X2\n";
+  {
+    auto parser = byfxxm::Gparser(std::ifstream(path));
+    Comments comments;
+    parser.SetOnComment([&](std::string_view text, size_t line) {
+      comments.emplace_back(text, line);
+    });
+    MotionGimpl gimpl;
+    auto res = parser.Run(&addr, &gimpl);
+    assert(!res && gimpl.xs == std::vector<double>({1, 2}));
+    assert(comments == Comments({{std::string(20000, 'a'), 1}}));
+  }
+  std::filesystem::remove(path);
+
+  // 未结束的注释只影响本行，后面的行照常校验
+  auto diags = byfxxm::Gparser(std::stringstream("G1 X1 (feed\nG1 X2 (a\n"
+                                                 "G1 X3\nG1 X@\n(end"))
+                   .Validate();
+  constexpr size_t lines[] = {1, 2, 4, 5};
+  assert(diags.size() == std::size(lines));
+  for (size_t i = 0; i < diags.size(); ++i) {
+    assert(diags[i].line == lines[i]);
+    assert(diags[i].code == byfxxm::errc::LEX);
+  }
+}
+
+void TestParser26() {
+  auto run = [](const char *source) {
+    std::vector<std::string> codes;
+    byfxxm::Gimpl gimpl([&](std::unique_ptr<byfxxm::Code> code) {
+      codes.push_back(FormatCode(*code));
+    });
+    byfxxm::Address addr;
+    auto res = byfxxm::Gparser(std::stringstream(source)).Run(&addr, &gimpl);
+    assert(!res);
+    return codes;
+  };
+
+  // 只有M、S、F的段不沿用G0/G1输出
+  assert(run("G0 X1 Y2\nM3 S1000\nF200\nG1 X5\n") ==
+         std::vector<std::string>({"G0 X1 Y2", "G1 X5"}));
+
+  // G99与G90、G81在同一段中，返回R平面
+  assert(run("G0 X0 Y0 Z10\nG99 G90 G81 X10 Z-5 R2\nX20\nG80\n") ==
+         std::vector<std::string>({"G0 X0 Y0 Z10", "G0 X10", "G0 Z2",
+                                   "G1 Z-5", "G0 Z2", "G0 X20", "G1 Z-5",
+                                   "G0 Z2"}));
+
+  // G98/G99单独成段也保持模态，且不随G80复位
+  assert(run("G0 Z10\nG99\nG81 X1 Z-1 R1\nG80\nG81 X2 Z-1 R1\nG80\n") ==
+         std::vector<std::string>({"G0 Z10", "G0 X1", "G0 Z1", "G1 Z-1",
+                                   "G0 Z1", "G0 X2", "G1 Z-1", "G0 Z1"}));
+}
+
+void TestRingBuffer() {
+  // 固定槽数时不存放槽数，两端的下标和元素各占一个缓存行
+  static_assert(sizeof(byfxxm::RingBuffer<int, 16>) ==
+                3 * byfxxm::cache_line_size);
+
+  byfxxm::RingBuffer<int, 5> ring;
+  assert(ring.IsEmpty() && !ring.IsFull());
+  int in[] = {1, 2, 3, 4, 5, 6};
+  int out[6]{};
+
+  // 批量读写在环尾处折返
+  auto written = ring.WriteBulk(in);
+  assert(written == 4 && ring.IsFull());
+  auto read = ring.ReadBulk(std::span(out, 3));
+  assert(read == 3);
+  written = ring.WriteBulk(std::span(in + 4, 2));
+  assert(written == 2);
+  read = ring.ReadBulk(std::span(out + 3, 3));
+  assert(read == 3 && ring.IsEmpty());
+  assert(std::ranges::equal(out, in));
+  read = ring.ReadBulk(out);
+  assert(read == 0);
+
+  // 跨线程时每个元素按顺序到达，满或空时让出时间片
+  constexpr size_t count = 100000;
+  byfxxm::RingBuffer<size_t, 8> spsc;
+  std::jthread producer([&]() {
+    size_t items[3];
+    for (size_t n = 0; n < count;) {
+      size_t size = 0;
+      if (n % 2 == 0) {
+        size = spsc.Write(size_t{n}) ? 1 : 0;
+      } else {
+        auto max = std::min(std::size(items), count - n);
+        for (size_t i = 0; i < max; ++i)
+          items[i] = n + i;
+        size = spsc.WriteBulk(std::span(items, max));
+      }
+
+      n += size;
+      if (size == 0)
+        std::this_thread::yield();
+    }
+  });
+
+  size_t items[4];
+  for (size_t n = 0; n < count;) {
+    auto size = spsc.ReadBulk(items);
+    if (size == 0)
+      std::this_thread::yield();
+
+    for (size_t i = 0; i < size; ++i, ++n)
+      assert(items[i] == n);
+  }
+}
+
 class MyFileStream {
 public:
   explicit MyFileStream(const std::filesystem::path &pa) {
@@ -267,6 +1163,9 @@ public:
     return *this;
   }
 
+  // 只在get之后调用，此时没有缓存的字符
+  auto tellg() { return ftell(_file); }
+
 private:
   FILE *_file{nullptr};
   std::optional<int> _cache;
@@ -307,22 +1206,215 @@ void TestPerformance1() {
           10000);
 }
 
-std::string _Format(const byfxxm::AxesArray &axes) {
-  std::string ret;
-  std::ranges::for_each(axes, [&](auto &&item) {
-    ret += " ";
-    ret += std::to_string(item);
-  });
+// 1到N个线程并发解析同一批程序，输出吞吐量和相对单线程的加速比
+void TestPerformance2() {
+  auto big = std::filesystem::temp_directory_path() / "pool_bench.nc";
+  {
+    std::ofstream out(big);
+    for (int i = 0; i < 20000; ++i) {
+      out << std::format("#{} = [#{} + {}.5] * 2 / 3 - MAX[{}, 3]\n",
+                         i % 50 + 1, (i + 7) % 50 + 1, i % 13, i % 90);
+      out << std::format("G1 X[#{} + 1] Y{} Z-1\n", i % 50 + 1, i);
+    }
+  }
 
-  return ret;
-}
+  std::vector<std::filesystem::path> jobs;
+  for (auto &entry : std::filesystem::directory_iterator(
+           std::filesystem::current_path() / "ncfiles")) {
+    if (entry.path().extension() == ".nc")
+      jobs.insert(jobs.end(), 100, entry.path());
+  }
+  jobs.insert(jobs.end(), 32, big);
 
-class Issuer : public byfxxm::Worker {
-private:
-  virtual bool Do(std::unique_ptr<byfxxm::Code> code,
-                  const byfxxm::WriteFunc &writefn) noexcept override {
-    switch (code->tag) {
-    case byfxxm::codetag::MOVE:
+  double length = 0;
+  for (auto &job : jobs)
+    length += static_cast<double>(std::filesystem::file_size(job)) / 1e6;
+
+  double base = 0;
+  auto max = std::max(std::thread::hardware_concurrency(), 1u);
+  for (size_t n = 1; n <= max; n *= 2) {
+    auto t0 = std::chrono::high_resolution_clock::now();
+    {
+      byfxxm::ParserPool pool(n);
+      std::vector<std::future<byfxxm::ParserPool::Result>> results;
+      for (auto &job : jobs)
+        results.push_back(pool.Run(std::ifstream(job)));
+
+      for (auto &res : results)
+        res.wait();
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    double cost =
+        std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() /
+        1e6;
+    if (n == 1)
+      base = cost;
+
+    PrintLine(std::format("{} threads: {:.2f} MB/s, speedup {:.2f}", n,
+                          length / cost, base / cost));
+  }
+
+  std::filesystem::remove(big);
+}
+
+// 同一段程序内联展开与作为子程序调用的耗时对比
+void TestPerformance3() {
+  constexpr int times = 10000;
+  const std::string body =
+      "#1 = #1 + 1\n#2 = [#1 * 2 + 3] / 4\nG1 X#2 Y#1\n";
+  byfxxm::Subprograms subprograms;
+  subprograms.Add(1, "O1\n" + body + "M99\n");
+
+  std::string inline_ = "#1 = 0\n";
+  std::string calls = inline_;
+  for (int i = 0; i < times; ++i) {
+    inline_ += body;
+    calls += "M98 P1\n";
+  }
+
+  auto measure = [&](const char *name, const std::string &source) {
+    auto t0 = std::chrono::high_resolution_clock::now();
+    auto parser = byfxxm::Gparser(std::stringstream(source));
+    parser.SetSubprograms(&subprograms);
+    MotionGimpl gimpl;
+    byfxxm::Address addr;
+    parser.Run(&addr, &gimpl);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(addr[1] == times);
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{}: {:.1f} ns per body", name,
+                          static_cast<double>(cost) / times));
+  };
+
+  measure("inline", inline_);
+  measure("M98 P1", calls);
+  measure("M98 P1 L10000", std::format("#1 = 0\nM98 P1 L{}\n", times));
+}
+
+// 5万个孔位的钻孔循环与同样多的G0段的耗时对比
+void TestPerformance4() {
+  constexpr int holes = 50000;
+  std::string cycle = "G0 X0 Y0 Z10\nG99 G81 Z-5 R2 X0 Y0\n";
+  std::string plain = "G0 X0 Y0 Z10\n";
+  for (int i = 1; i < holes; ++i) {
+    cycle += std::format("X{} Y{}\n", i % 500, i / 500);
+    plain += std::format("G0 X{} Y{}\n", i % 500, i / 500);
+  }
+
+  auto measure = [&](const char *name, const std::string &source) {
+    size_t count = 0;
+    byfxxm::Gimpl gimpl([&](std::unique_ptr<byfxxm::Code>) { ++count; });
+    auto t0 = std::chrono::high_resolution_clock::now();
+    auto parser = byfxxm::Gparser(std::stringstream(source));
+    byfxxm::Address addr;
+    parser.Run(&addr, &gimpl);
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{}: {} codes, {:.1f} ns per line", name, count,
+                          static_cast<double>(cost) / holes));
+  };
+
+  measure("G81", cycle);
+  measure("G0", plain);
+}
+
+void TestPerformance5() {
+  constexpr size_t rounds = 1000000;
+  byfxxm::Coro co;
+  co.SetMain([&](byfxxm::CoMainHelper *helper, void *) {
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < rounds; ++i)
+      helper->SwitchToSub(0);
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("coro: {:.1f} ns per round trip",
+                          static_cast<double>(cost) / rounds));
+  });
+  co.AddSub([](byfxxm::CoSubHelper *helper, void *) {
+    for (;;)
+      helper->SwitchToMain();
+  });
+  co.Run();
+}
+
+void TestPerformance8() {
+  constexpr size_t count = 10000000;
+  auto measure = [&](const char *name, size_t batch) {
+    byfxxm::RingBuffer<size_t, 1024> ring;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    std::jthread producer([&]() {
+      std::vector<size_t> items(batch);
+      for (size_t n = 0; n < count;) {
+        size_t size = 0;
+        if (batch == 1) {
+          size = ring.Write(size_t{n});
+        } else {
+          for (size_t i = 0; i < batch; ++i)
+            items[i] = n + i;
+          size = ring.WriteBulk(
+              std::span(items).first(std::min(batch, count - n)));
+        }
+
+        // 只有一个核时让对端运行
+        if (size == 0)
+          std::this_thread::yield();
+        n += size;
+      }
+    });
+
+    size_t sum = 0;
+    std::vector<size_t> items(batch);
+    for (size_t n = 0; n < count;) {
+      size_t size = 0;
+      if (batch == 1) {
+        size = ring.Read(items[0]);
+      } else {
+        size = ring.ReadBulk(items);
+      }
+
+      if (size == 0)
+        std::this_thread::yield();
+      for (size_t i = 0; i < size; ++i)
+        sum += items[i];
+      n += size;
+    }
+    producer.join();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(sum == count * (count - 1) / 2);
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("ring buffer {}: {:.1f} M ops/s", name,
+                          count * 1e3 / static_cast<double>(cost)));
+  };
+
+  measure("single", 1);
+  measure("bulk 64", 64);
+}
+
+std::string _Format(const byfxxm::AxesArray &axes) {
+  std::string ret;
+  std::ranges::for_each(axes, [&](auto &&item) {
+    ret += " ";
+    ret += std::to_string(item);
+  });
+
+  return ret;
+}
+
+class Issuer : public byfxxm::Worker {
+private:
+  virtual bool Do(std::unique_ptr<byfxxm::Code> code,
+                  const byfxxm::WriteFunc &writefn) noexcept override {
+    switch (code->tag) {
+    case byfxxm::codetag::MOVE:
       Print("G0");
       PrintLine(_Format(static_cast<byfxxm::Move *>(code.get())->end));
       break;
@@ -379,6 +1471,36 @@ public:
   }
 };
 
+void TestCoro() {
+  std::vector<int> trace;
+  byfxxm::Coro co;
+  co.SetStackSize(64 * 1024);
+  co.SetMain([&](byfxxm::CoMainHelper *helper, void *) {
+    for (int i = 0; i < 3; ++i) {
+      trace.push_back(0);
+      helper->SwitchToSub(i % 2);
+    }
+
+    // 函数已返回的子协程再切入时直接回到主协程
+    helper->SwitchToSub(2);
+    helper->SwitchToSub(2);
+  });
+  for (int n = 1; n <= 2; ++n) {
+    co.AddSub([&, n](byfxxm::CoSubHelper *helper, void *) {
+      for (;;) {
+        trace.push_back(n);
+        helper->SwitchToMain();
+      }
+    });
+  }
+  co.AddSub([&](byfxxm::CoSubHelper *, void *) {
+    double x = 1.5;
+    trace.push_back(static_cast<int>(x * 2));
+  });
+  co.Run();
+  assert(trace == std::vector<int>({0, 1, 0, 2, 0, 1, 3}));
+}
+
 void TestPipeline() {
   auto pipeline = byfxxm::Pipeline();
   pipeline.AddWorker(std::make_unique<FirstWorker>());
@@ -398,15 +1520,852 @@ void TestPipeline() {
 void TestPipeline1() {
   auto pipeline = byfxxm::Pipeline();
   pipeline.AddWorker(
-      std::make_unique<byfxxm::Gworker>(std::stringstream(R"(G0 X0Y0Z0
+      std::make_unique<byfxxm::Gworker>(byfxxm::StaticStream<R"(G0 X0Y0Z0
 G1X100
 Y100
-)")));
+)">()));
   pipeline.AddWorker(std::make_unique<Issuer>());
   pipeline.Start();
   pipeline.Wait();
 }
 
+class CountWorker : public byfxxm::Worker {
+public:
+  explicit CountWorker(size_t codes) : _codes(codes) {}
+
+  bool Do(std::unique_ptr<byfxxm::Code> code,
+          const byfxxm::WriteFunc &write) noexcept override {
+    if (!code) {
+      for (size_t i = 0; i < _codes; ++i)
+        write(std::make_unique<TestCode>(i));
+    } else if (_codes == 0) {
+      write(std::move(code));
+    } else {
+      ++_count;
+    }
+
+    return true;
+  }
+
+  size_t Count() const { return _count; }
+
+private:
+  size_t _codes{0};
+  size_t _count{0};
+};
+
+void TestPerformance6() {
+  constexpr size_t codes = 200000;
+  auto pipeline = byfxxm::Pipeline();
+  pipeline.AddWorker(std::make_unique<CountWorker>(codes));
+  for (int i = 0; i < 20; ++i)
+    pipeline.AddWorker(std::make_unique<CountWorker>(0));
+
+  auto last = std::make_unique<CountWorker>(1);
+  auto &sink = *last;
+  pipeline.AddWorker(std::move(last));
+  auto t0 = std::chrono::high_resolution_clock::now();
+  pipeline.Start();
+  pipeline.Wait();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  assert(sink.Count() == codes);
+
+  auto cost =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+  PrintLine(std::format("pipeline: {:.0f} codes/s through 22 stations",
+                        codes * 1e9 / static_cast<double>(cost)));
+}
+
+class OrderWorker : public byfxxm::Worker {
+public:
+  bool Do(std::unique_ptr<byfxxm::Code> code,
+          const byfxxm::WriteFunc &) noexcept override {
+    ns.push_back(static_cast<TestCode *>(code.get())->_n);
+    return true;
+  }
+
+  std::vector<size_t> ns;
+};
+
+void TestPipeline2() {
+  constexpr size_t codes = 10000;
+  for (auto threaded : {false, true}) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.SetThreaded(threaded, {.spins = 16, .yields = 4});
+    pipeline.AddWorker(std::make_unique<CountWorker>(codes));
+    for (int i = 0; i < 20; ++i)
+      pipeline.AddWorker(std::make_unique<CountWorker>(0));
+
+    auto last = std::make_unique<OrderWorker>();
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    pipeline.Start();
+    pipeline.Wait();
+
+    // 两种模式下每个码都按顺序到达
+    assert(sink.ns.size() == codes);
+    for (size_t i = 0; i < codes; ++i)
+      assert(sink.ns[i] == i);
+  }
+
+  // 线程模式下工位出错时停止，阻塞的工位被唤醒后结束
+  auto pipeline = byfxxm::Pipeline();
+  pipeline.SetThreaded(true);
+  pipeline.AddWorker(std::make_unique<FirstWorker>());
+  for (int i = 0; i < 20; ++i)
+    pipeline.AddWorker(std::make_unique<TestWorker>());
+
+  pipeline.AddWorker(std::make_unique<OrderWorker>());
+  pipeline.Start();
+  pipeline.Wait();
+}
+
+// 每个输入产生burst个码，模拟圆弧分段
+class BurstWorker : public byfxxm::Worker {
+public:
+  explicit BurstWorker(size_t burst) : _burst(burst) {}
+
+  bool Do(std::unique_ptr<byfxxm::Code> code,
+          const byfxxm::WriteFunc &write) noexcept override {
+    auto n = static_cast<TestCode *>(code.get())->_n;
+    for (size_t i = 0; i < _burst; ++i)
+      write(std::make_unique<TestCode>(n * _burst + i));
+
+    return true;
+  }
+
+private:
+  size_t _burst{0};
+};
+
+void TestPipeline3() {
+  constexpr size_t inputs = 100;
+  constexpr size_t burst = 300;
+  auto pipeline = byfxxm::Pipeline();
+  pipeline.SetAdaptive(true, {.max = 256, .total = 1024});
+  pipeline.AddWorker(std::make_unique<CountWorker>(inputs), 8);
+  pipeline.AddWorker(std::make_unique<BurstWorker>(burst));
+  for (int i = 0; i < 5; ++i)
+    pipeline.AddWorker(std::make_unique<CountWorker>(0));
+
+  auto last = std::make_unique<OrderWorker>();
+  auto &sink = *last;
+  pipeline.AddWorker(std::move(last));
+  assert(pipeline.GetStation(0).Capacity() == 8);
+  assert(pipeline.GetStation(1).Capacity() == byfxxm::default_fifo_capacity);
+  pipeline.Start();
+  pipeline.Wait();
+
+  assert(sink.ns.size() == inputs * burst);
+  for (size_t i = 0; i < sink.ns.size(); ++i)
+    assert(sink.ns[i] == i);
+
+  // 突发的工位扩容，总容量不超过上限
+  size_t total = 0;
+  for (size_t i = 0; i < 7; ++i) {
+    auto &sta = pipeline.GetStation(i);
+    assert(sta.Capacity() >= byfxxm::default_fifo_capacity &&
+           sta.Capacity() <= 256);
+    total += sta.Capacity();
+  }
+  assert(total <= 1024);
+  assert(pipeline.GetStation(1).Capacity() > byfxxm::default_fifo_capacity);
+  assert(pipeline.GetStation(1).full_stalls > 0);
+}
+
+// 整批转发，第一个工位时产生codes个码
+class BatchCountWorker : public byfxxm::BatchWorker {
+public:
+  explicit BatchCountWorker(size_t codes = 0) : _codes(codes) {}
+
+  bool DoBatch(byfxxm::Codes codes,
+               const byfxxm::WriteBatchFunc &write) noexcept override {
+    if (!codes.empty()) {
+      write(codes);
+      return true;
+    }
+
+    std::unique_ptr<byfxxm::Code> batch[16];
+    for (size_t n = 0; n < _codes;) {
+      size_t size = 0;
+      for (; size < std::size(batch) && n < _codes; ++size)
+        batch[size] = std::make_unique<TestCode>(n++);
+
+      write(byfxxm::Codes(batch, size));
+    }
+
+    return true;
+  }
+
+private:
+  size_t _codes{0};
+};
+
+void TestPipeline4() {
+  constexpr size_t codes = 10000;
+  for (auto threaded : {false, true}) {
+    // 批量工位与逐个处理的工位混合
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.SetThreaded(threaded, {.spins = 16, .yields = 4});
+    pipeline.AddWorker(std::make_unique<BatchCountWorker>(codes), 32);
+    for (int i = 0; i < 10; ++i) {
+      if (i % 3 == 0)
+        pipeline.AddWorker(std::make_unique<CountWorker>(0));
+      else
+        pipeline.AddWorker(std::make_unique<BatchCountWorker>(), 16);
+    }
+
+    auto last = std::make_unique<OrderWorker>();
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    pipeline.Start();
+    pipeline.Wait();
+
+    assert(sink.ns.size() == codes);
+    for (size_t i = 0; i < codes; ++i)
+      assert(sink.ns[i] == i);
+  }
+}
+
+void TestPipeline5() {
+  constexpr size_t codes = 20000;
+  for (auto threaded : {false, true}) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.SetThreaded(threaded);
+    pipeline.AddWorker(std::make_unique<byfxxm::Gworker>(std::stringstream(
+        std::format("#1 = 0\nWHILE [#1 LT {}] DO\n  G1 X#1 Y[#1 * 2]\n  "
+                    "#1 = #1 + 1\nEND\n",
+                    codes))));
+    for (int i = 0; i < 3; ++i)
+      pipeline.AddWorker(std::make_unique<CountWorker>(0));
+
+    auto last = std::make_unique<CountWorker>(1);
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+
+    // 每个码及其坐标各分配一次，只有流水线填满之前访问全局堆
+    // 线程模式下在途的码更多，经通道交还后同样不随码数增长
+    auto heap = byfxxm::Recycler::HeapAllocations();
+    pipeline.Start();
+    pipeline.Wait();
+    assert(sink.Count() == codes);
+    assert(byfxxm::Recycler::HeapAllocations() - heap <
+           (threaded ? 2000 : 100));
+  }
+}
+
+// 第一个工位时产生codes个Line，codes为0时把X加1后转发，否则作为最后一个工位计数
+template <class C> class LineWorker : public byfxxm::BasicWorker<C> {
+public:
+  explicit LineWorker(size_t codes = 0) : _codes(codes) {}
+
+  bool Do(byfxxm::CodeArg<C> code,
+          const byfxxm::BasicWriteFunc<C> &write) noexcept override {
+    constexpr bool record = std::is_same_v<C, byfxxm::CodeRecord>;
+    if (!code) {
+      for (size_t i = 0; i < _codes; ++i) {
+        auto x = static_cast<double>(i);
+        byfxxm::record::Line line{{x, x * 2, 0, 0, 0, 0}};
+        if constexpr (record)
+          write(line);
+        else
+          write(byfxxm::ToCode(line));
+      }
+    } else if (_codes == 0) {
+      if constexpr (record) {
+        auto out = code;
+        if (auto line = out.template Get<byfxxm::record::Line>())
+          line->end[0] += 1;
+
+        write(out);
+      } else {
+        if (code->tag == byfxxm::codetag::LINE)
+          static_cast<byfxxm::Line &>(*code).end[0] += 1;
+
+        write(std::move(code));
+      }
+    } else {
+      ++_count;
+      if constexpr (record)
+        _sum += code.template Get<byfxxm::record::Line>()->end[0];
+      else
+        _sum += static_cast<byfxxm::Line &>(*code).end[0];
+    }
+
+    return true;
+  }
+
+  size_t Count() const { return _count; }
+  double Sum() const { return _sum; }
+
+private:
+  size_t _codes{0};
+  size_t _count{0};
+  double _sum{0};
+};
+
+std::string _FormatAxes(const byfxxm::Axes &axes, const char *names) {
+  std::string ret;
+  for (size_t i = 0; i < 3; ++i) {
+    if (!byfxxm::IsNaN(axes[i]))
+      ret += std::format(" {}{}", names[i], axes[i]);
+  }
+
+  return ret;
+}
+
+std::string FormatRecord(const byfxxm::CodeRecord &rec) {
+  return rec.Visit([](auto &&code) -> std::string {
+    using T = std::decay_t<decltype(code)>;
+    if constexpr (std::is_same_v<T, byfxxm::record::Move>)
+      return "G0" + _FormatAxes(code.end, "XYZ");
+    else if constexpr (std::is_same_v<T, byfxxm::record::Line>)
+      return "G1" + _FormatAxes(code.end, "XYZ");
+    else if constexpr (std::is_same_v<T, byfxxm::record::Arc>)
+      return (code.ccw ? "G3" : "G2") + _FormatAxes(code.end, "XYZ") +
+             _FormatAxes(code.center, "IJK");
+    else
+      return "";
+  });
+}
+
+// 多态码先转换为记录再输出
+template <class C> class FormatSink : public byfxxm::BasicWorker<C> {
+public:
+  bool Do(byfxxm::CodeArg<C> code,
+          const byfxxm::BasicWriteFunc<C> &) noexcept override {
+    if constexpr (std::is_same_v<C, byfxxm::CodeRecord>)
+      lines.push_back(FormatRecord(code));
+    else
+      lines.push_back(FormatRecord(byfxxm::ToRecord(code.get())));
+
+    return true;
+  }
+
+  std::vector<std::string> lines;
+};
+
+void TestPipeline6() {
+  constexpr auto source = R"(G0 X0Y0Z10
+G1 X10 Y5
+G2 X20 Y5 I5 J0
+G3 X10 Y5 I-5
+G99 G81 Z-5 R2 X30 Y30
+X40
+G80 G0 Z10
+)";
+  auto run = [&]<class C>(std::type_identity<C>) {
+    auto pipeline = byfxxm::BasicPipeline<C>();
+    pipeline.AddWorker(std::make_unique<byfxxm::BasicGworker<C>>(
+        std::stringstream(source)));
+    for (int i = 0; i < 3; ++i)
+      pipeline.AddWorker(std::make_unique<LineWorker<C>>());
+
+    auto last = std::make_unique<FormatSink<C>>();
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    pipeline.Start();
+    pipeline.Wait();
+    return sink.lines;
+  };
+
+  // 中间三个工位各把G1的X加1
+  auto lines = run(std::type_identity<byfxxm::CodeRecord>());
+  assert(lines == run(std::type_identity<std::unique_ptr<byfxxm::Code>>()));
+  assert(lines == std::vector<std::string>({
+                      "G0 X0 Y0 Z10",
+                      "G1 X13 Y5",
+                      "G2 X20 Y5 I5 J0",
+                      "G3 X10 Y5 I-5",
+                      "G0 X30 Y30", "G0 Z2", "G1 Z-5", "G0 Z2",
+                      "G0 X40", "G1 Z-5", "G0 Z2",
+                      "G0 Z10",
+                  }));
+
+  // 记录与多态码互相转换不丢失内容
+  byfxxm::CodeRecord arc = byfxxm::record::Arc{
+      byfxxm::MakeAxes(1, 2, 3), byfxxm::MakeAxes(4, 5, 6), true};
+  assert(FormatRecord(byfxxm::ToRecord(byfxxm::ToCode(arc).get())) ==
+         "G3 X1 Y2 Z3 I4 J5 K6");
+  assert(!byfxxm::ToRecord(nullptr) && !byfxxm::ToCode({}));
+  assert(arc.Tag() == byfxxm::codetag::ARC);
+}
+
+// 静态流水线的第一个工位，产生codes个Line
+struct LineStage {
+  using Input = void;
+  using Output = byfxxm::CodeRecord;
+
+  template <class Write> bool Do(Write &&write) {
+    for (size_t i = 0; i < codes; ++i) {
+      auto x = static_cast<double>(i);
+      write(byfxxm::record::Line{{x, x * 2, 0, 0, 0, 0}});
+    }
+
+    return true;
+  }
+
+  size_t codes{0};
+};
+
+// 把Line的X加1，X达到limit时出错
+struct OffsetStage {
+  using Input = byfxxm::CodeRecord;
+  using Output = byfxxm::CodeRecord;
+
+  template <class Write>
+  bool Do(const byfxxm::CodeRecord &code, Write &&write) {
+    auto out = code;
+    if (auto line = out.Get<byfxxm::record::Line>()) {
+      if (line->end[0] >= limit)
+        return false;
+
+      line->end[0] += 1;
+    }
+
+    write(out);
+    return true;
+  }
+
+  double limit{std::numeric_limits<double>::infinity()};
+};
+
+struct SinkStage {
+  using Input = byfxxm::CodeRecord;
+  using Output = void;
+
+  bool Do(const byfxxm::CodeRecord &code) {
+    ++count;
+    if (auto line = code.Get<byfxxm::record::Line>())
+      sum += line->end[0];
+
+    return true;
+  }
+
+  size_t count{0};
+  double sum{0};
+};
+
+// 取出X，改变码的类型
+struct XStage {
+  using Input = byfxxm::CodeRecord;
+  using Output = double;
+
+  template <class Write>
+  bool Do(const byfxxm::CodeRecord &code, Write &&write) {
+    if (auto line = code.Get<byfxxm::record::Line>())
+      write(line->end[0]);
+
+    return true;
+  }
+};
+
+struct XSink {
+  using Input = double;
+  using Output = void;
+
+  bool Do(double x) {
+    xs.push_back(x);
+    return true;
+  }
+
+  std::vector<double> xs;
+};
+
+void TestPipeline7() {
+  static_assert(byfxxm::stages_linked<LineStage, OffsetStage, SinkStage>);
+  static_assert(!byfxxm::stages_linked<LineStage, XSink>);
+  static_assert(!byfxxm::stages_linked<OffsetStage, SinkStage>);
+  static_assert(!byfxxm::stages_linked<LineStage, XStage>);
+
+  constexpr size_t codes = 1000;
+  byfxxm::StaticPipeline<LineStage, OffsetStage, OffsetStage, XStage, XSink>
+      typed;
+  typed.Get<0>().codes = codes;
+  auto ok = typed.Run();
+  assert(ok);
+  auto &xs = typed.Get<4>().xs;
+  assert(xs.size() == codes);
+  for (size_t i = 0; i < codes; ++i)
+    assert(xs[i] == i + 2.0);
+
+  // 同样的工位按协程执行，结果相同
+  byfxxm::StaticPipeline<LineStage, OffsetStage, SinkStage> fused;
+  fused.Get<0>().codes = codes;
+  ok = fused.Run();
+  assert(ok);
+
+  auto pipeline = byfxxm::RecordPipeline();
+  pipeline.AddWorker(
+      std::make_unique<byfxxm::StageWorker<LineStage>>(LineStage{codes}));
+  pipeline.AddWorker(std::make_unique<byfxxm::StageWorker<OffsetStage>>());
+  auto last = std::make_unique<byfxxm::StageWorker<SinkStage>>();
+  auto &sink = last->Stage();
+  pipeline.AddWorker(std::move(last));
+  pipeline.Start();
+  pipeline.Wait();
+  assert(sink.count == codes && fused.Get<2>().count == codes);
+  assert(sink.sum == fused.Get<2>().sum);
+
+  // 出错后之后的码全部丢弃
+  byfxxm::StaticPipeline<LineStage, OffsetStage, SinkStage> failed;
+  failed.Get<0>().codes = codes;
+  failed.Get<1>().limit = 100;
+  ok = failed.Run();
+  assert(!ok);
+  assert(failed.Get<2>().count == 100);
+}
+
+void TestPipeline8() {
+  using Ptr = std::unique_ptr<byfxxm::Code>;
+  auto start = [](byfxxm::Pipeline &pipeline, bool run) {
+    if (run)
+      return pipeline.Run();
+
+    pipeline.Start();
+    pipeline.Wait();
+    return true;
+  };
+
+  // 直接执行到结束与协程模式下，最后一个工位收到的码相同
+  auto format = [&](bool run) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.AddWorker(std::make_unique<byfxxm::Gworker>(std::ifstream(
+        std::filesystem::current_path().string() + "/ncfiles/test18.nc")));
+    for (int i = 0; i < 3; ++i)
+      pipeline.AddWorker(std::make_unique<LineWorker<Ptr>>());
+
+    auto last = std::make_unique<FormatSink<Ptr>>();
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    auto ok = start(pipeline, run);
+    assert(ok);
+    return sink.lines;
+  };
+
+  auto lines = format(true);
+  assert(!lines.empty() && lines == format(false));
+
+  // 批量工位与逐个处理的工位混合，按顺序到达
+  constexpr size_t codes = 10000;
+  auto pipeline = byfxxm::Pipeline();
+  pipeline.AddWorker(std::make_unique<BatchCountWorker>(codes));
+  for (int i = 0; i < 10; ++i) {
+    if (i % 3 == 0)
+      pipeline.AddWorker(std::make_unique<CountWorker>(0));
+    else
+      pipeline.AddWorker(std::make_unique<BatchCountWorker>());
+  }
+
+  auto last = std::make_unique<OrderWorker>();
+  auto &sink = *last;
+  pipeline.AddWorker(std::move(last));
+  for (int n = 0; n < 2; ++n) {
+    sink.ns.clear();
+    auto ok = pipeline.Run();
+    assert(ok && sink.ns.size() == codes);
+    for (size_t i = 0; i < codes; ++i)
+      assert(sink.ns[i] == i);
+  }
+
+  // 工位出错后停止，之后写出的码全部丢弃
+  for (auto run : {false, true}) {
+    auto failed = byfxxm::Pipeline();
+    failed.AddWorker(std::make_unique<CountWorker>(codes));
+    failed.AddWorker(std::make_unique<TestWorker>());
+    auto last = std::make_unique<CountWorker>(1);
+    auto &sink = *last;
+    failed.AddWorker(std::move(last));
+    auto ok = start(failed, run);
+    assert(sink.Count() <= 1000);
+    assert(!run || (!ok && sink.Count() == 1000));
+  }
+}
+
+// 收到第一个码就出错
+class FailWorker : public byfxxm::Worker {
+public:
+  bool Do(std::unique_ptr<byfxxm::Code>,
+          const byfxxm::WriteFunc &) noexcept override {
+    return false;
+  }
+};
+
+void TestPipeline9() {
+  auto build = [](auto &pipeline) {
+    pipeline.AddWorker(std::make_unique<byfxxm::Gworker>(
+        std::stringstream("#1 = 0\nWHILE [#1 LT 1] DO\nG1 X1\nEND\n")));
+    pipeline.AddWorker(std::make_unique<FailWorker>());
+    auto last = std::make_unique<CountWorker>(1);
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    return &sink;
+  };
+
+  // 源程序是死循环，下游出错后解析随之结束，协程和线程模式都能返回
+  for (auto threaded : {false, true}) {
+    auto pipeline = byfxxm::Pipeline();
+    auto sink = build(pipeline);
+    pipeline.SetThreaded(threaded);
+    pipeline.Start();
+    pipeline.Wait();
+    assert(sink->Count() == 0);
+  }
+
+  // 直接执行到结束时同样返回，RunPipeline不依赖协程
+  auto pipeline = byfxxm::Pipeline();
+  auto sink = build(pipeline);
+  auto ok = pipeline.Run();
+  assert(!ok && sink->Count() == 0);
+
+  auto run = byfxxm::RunPipeline();
+  sink = build(run);
+  ok = run.Run();
+  assert(!ok && sink->Count() == 0);
+}
+
+struct TimedCode : TestCode {
+  TimedCode(size_t n)
+      : TestCode(n), time(std::chrono::steady_clock::now()) {}
+  std::chrono::steady_clock::time_point time;
+};
+
+class TimedSource : public byfxxm::Worker {
+public:
+  explicit TimedSource(size_t codes) : _codes(codes) {}
+
+  bool Do(std::unique_ptr<byfxxm::Code>,
+          const byfxxm::WriteFunc &write) noexcept override {
+    for (size_t i = 0; i < _codes; ++i)
+      write(std::make_unique<TimedCode>(i));
+
+    return true;
+  }
+
+private:
+  size_t _codes{0};
+};
+
+class LatencySink : public byfxxm::Worker {
+public:
+  bool Do(std::unique_ptr<byfxxm::Code> code,
+          const byfxxm::WriteFunc &) noexcept override {
+    latency += std::chrono::steady_clock::now() -
+               static_cast<TimedCode *>(code.get())->time;
+    ++count;
+    return true;
+  }
+
+  std::chrono::nanoseconds latency{0};
+  size_t count{0};
+};
+
+void TestPerformance7() {
+  constexpr size_t codes = 200000;
+  auto measure = [&](const char *name, bool threaded) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.SetThreaded(threaded);
+    pipeline.AddWorker(std::make_unique<TimedSource>(codes));
+    for (int i = 0; i < 20; ++i)
+      pipeline.AddWorker(std::make_unique<CountWorker>(0));
+
+    auto last = std::make_unique<LatencySink>();
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    auto t0 = std::chrono::high_resolution_clock::now();
+    pipeline.Start();
+    pipeline.Wait();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(sink.count == codes);
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{}: {:.0f} codes/s, {:.1f} us mean latency", name,
+                          codes * 1e9 / static_cast<double>(cost),
+                          sink.latency.count() / 1e3 / codes));
+  };
+
+  measure("fiber", false);
+  measure("thread", true);
+}
+
+void TestPerformance9() {
+  constexpr size_t inputs = 1000;
+  constexpr size_t burst = 300;
+  auto measure = [&](const char *name, bool adaptive) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.SetAdaptive(adaptive);
+    pipeline.AddWorker(std::make_unique<CountWorker>(inputs));
+    pipeline.AddWorker(std::make_unique<BurstWorker>(burst));
+    for (int i = 0; i < 10; ++i)
+      pipeline.AddWorker(std::make_unique<CountWorker>(0));
+
+    auto last = std::make_unique<CountWorker>(1);
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    auto t0 = std::chrono::high_resolution_clock::now();
+    pipeline.Start();
+    pipeline.Wait();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(sink.Count() == inputs * burst);
+
+    size_t stalls = 0;
+    for (size_t i = 0; i < 12; ++i)
+      stalls += pipeline.GetStation(i).full_stalls;
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{} fifo: {:.0f} codes/s, {} full stalls", name,
+                          inputs * burst * 1e9 / static_cast<double>(cost),
+                          stalls));
+  };
+
+  measure("fixed", false);
+  measure("adaptive", true);
+}
+
+void TestPerformance10() {
+  constexpr size_t codes = 200000;
+  auto measure = [&](const char *name, bool batch) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.AddWorker(std::make_unique<BatchCountWorker>(codes), 64);
+    for (int i = 0; i < 20; ++i) {
+      if (batch)
+        pipeline.AddWorker(std::make_unique<BatchCountWorker>(), 64);
+      else
+        pipeline.AddWorker(std::make_unique<CountWorker>(0), 64);
+    }
+
+    auto last = std::make_unique<CountWorker>(1);
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    auto t0 = std::chrono::high_resolution_clock::now();
+    pipeline.Start();
+    pipeline.Wait();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(sink.Count() == codes);
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{} workers: {:.0f} codes/s through 22 stations",
+                          name, codes * 1e9 / static_cast<double>(cost)));
+  };
+
+  measure("single", false);
+  measure("batch", true);
+}
+
+void TestPerformance11() {
+  constexpr size_t codes = 200000;
+  auto measure = [&]<class C>(const char *name, std::type_identity<C>) {
+    auto pipeline = byfxxm::BasicPipeline<C>();
+    pipeline.AddWorker(std::make_unique<LineWorker<C>>(codes), 64);
+    for (int i = 0; i < 20; ++i)
+      pipeline.AddWorker(std::make_unique<LineWorker<C>>(), 64);
+
+    auto last = std::make_unique<LineWorker<C>>(1);
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    auto t0 = std::chrono::high_resolution_clock::now();
+    pipeline.Start();
+    pipeline.Wait();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(sink.Count() == codes);
+    assert(sink.Sum() == codes * (codes - 1.0) / 2 + codes * 20.0);
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{}: {:.0f} codes/s through 22 stations", name,
+                          codes * 1e9 / static_cast<double>(cost)));
+  };
+
+  measure("pointer", std::type_identity<std::unique_ptr<byfxxm::Code>>());
+  measure("record", std::type_identity<byfxxm::CodeRecord>());
+}
+
+template <size_t> struct _Repeat {
+  using type = OffsetStage;
+};
+
+template <size_t... I>
+byfxxm::StaticPipeline<LineStage, typename _Repeat<I>::type..., SinkStage>
+    _MakeOffsetChain(std::index_sequence<I...>);
+
+// 22个工位，与TestPerformance6相同
+using OffsetChain = decltype(_MakeOffsetChain(std::make_index_sequence<20>()));
+
+void TestPerformance12() {
+  constexpr size_t codes = 200000;
+  auto report = [&](const char *name, auto t0, auto t1) {
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{}: {:.0f} codes/s through 22 stations", name,
+                          codes * 1e9 / static_cast<double>(cost)));
+  };
+
+  auto fused = std::make_unique<OffsetChain>();
+  fused->Get<0>().codes = codes;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  fused->Run();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  assert(fused->Get<21>().count == codes);
+  report("static fused", t0, t1);
+
+  auto pipeline = byfxxm::RecordPipeline();
+  pipeline.AddWorker(
+      std::make_unique<byfxxm::StageWorker<LineStage>>(LineStage{codes}), 64);
+  for (int i = 0; i < 20; ++i)
+    pipeline.AddWorker(std::make_unique<byfxxm::StageWorker<OffsetStage>>(),
+                       64);
+
+  auto last = std::make_unique<byfxxm::StageWorker<SinkStage>>();
+  auto &sink = last->Stage();
+  pipeline.AddWorker(std::move(last));
+  t0 = std::chrono::high_resolution_clock::now();
+  pipeline.Start();
+  pipeline.Wait();
+  t1 = std::chrono::high_resolution_clock::now();
+  assert(sink.count == codes && sink.sum == fused->Get<21>().sum);
+  report("stage workers on fibers", t0, t1);
+}
+
+void TestPerformance13() {
+  constexpr size_t codes = 200000;
+  auto measure = [&](const char *name, bool run, bool batch) {
+    auto pipeline = byfxxm::Pipeline();
+    pipeline.AddWorker(std::make_unique<BatchCountWorker>(codes), 64);
+    for (int i = 0; i < 20; ++i) {
+      if (batch)
+        pipeline.AddWorker(std::make_unique<BatchCountWorker>(), 64);
+      else
+        pipeline.AddWorker(std::make_unique<CountWorker>(0), 64);
+    }
+
+    auto last = std::make_unique<CountWorker>(1);
+    auto &sink = *last;
+    pipeline.AddWorker(std::move(last));
+    auto t0 = std::chrono::high_resolution_clock::now();
+    if (run) {
+      pipeline.Run();
+    } else {
+      pipeline.Start();
+      pipeline.Wait();
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    assert(sink.Count() == codes);
+
+    auto cost =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    PrintLine(std::format("{}: {:.0f} codes/s through 22 stations", name,
+                          codes * 1e9 / static_cast<double>(cost)));
+  };
+
+  measure("single workers on fibers", false, false);
+  measure("single workers run to completion", true, false);
+  measure("batch workers on fibers", false, true);
+  measure("batch workers run to completion", true, true);
+}
+
 int main() {
   std::jthread thr[1];
   for (auto &t : thr) {
@@ -421,9 +2380,48 @@ int main() {
       TestParser7();
       TestParser8();
       TestParser9();
+      TestParser10();
+      TestParser11();
+      TestParser12();
+      TestParser13();
+      TestParser14();
+      TestParser15();
+      TestParser16();
+      TestParser17();
+      TestParser18();
+      TestParser19();
+      TestParser20();
+      TestParser21();
+      TestParser22();
+      TestParser23();
+      TestParser24();
+      TestParser25();
+      TestParser26();
+      TestCoro();
+      TestPipeline2();
+      TestRingBuffer();
+      TestPipeline3();
+      TestPipeline4();
+      TestPipeline5();
+      TestPipeline6();
+      TestPipeline7();
+      TestPipeline8();
+      TestPipeline9();
 #ifndef _DEBUG
       TestPerformance();
       TestPerformance1();
+      TestPerformance2();
+      TestPerformance3();
+      TestPerformance4();
+      TestPerformance5();
+      TestPerformance6();
+      TestPerformance7();
+      TestPerformance8();
+      TestPerformance9();
+      TestPerformance10();
+      TestPerformance11();
+      TestPerformance12();
+      TestPerformance13();
 #endif
     });
   }